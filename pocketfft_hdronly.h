@@ -51,6 +51,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define POCKETFFT_CACHE_SIZE 0
 #endif
 
+#ifndef POCKETFFT_CACHE_MEMORY
+#define POCKETFFT_CACHE_MEMORY (~std::size_t(0))
+#endif
+
 #include <cmath>
 #include <cstdlib>
 #include <stdexcept>
@@ -58,9 +62,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <complex>
 #include <algorithm>
-#if POCKETFFT_CACHE_SIZE!=0
-#include <array>
+#include <atomic>
 #include <mutex>
+#include <list>
+#include <unordered_map>
+#include <typeinfo>
+#include <typeindex>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define POCKETFFT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #ifndef POCKETFFT_NO_MULTITHREADING
@@ -88,23 +108,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define POCKETFFT_RESTRICT
 #endif
 
-namespace pocketfft {
-
-namespace detail {
-using std::size_t;
-using std::ptrdiff_t;
-
-// Always use std:: for <cmath> functions
-template <typename T> T cos(T) = delete;
-template <typename T> T sin(T) = delete;
-template <typename T> T sqrt(T) = delete;
-
-using shape_t = std::vector<size_t>;
-using stride_t = std::vector<ptrdiff_t>;
-
-constexpr bool FORWARD  = true,
-               BACKWARD = false;
-
 // only enable vector support for gcc>=5.0 and clang>=5.0
 #ifndef POCKETFFT_NO_VECTORS
 #define POCKETFFT_NO_VECTORS
@@ -126,13 +129,122 @@ constexpr bool FORWARD  = true,
 #endif
 #endif
 
+/* Runtime dispatch: everything below is compiled once for the instruction set
+   selected by the compiler flags, and once more each for AVX2 and AVX-512
+   (unless the flags already include them), in the namespaces isa_base,
+   isa_avx2 and isa_avx512. The public functions forward to the variant
+   matching the CPU. This needs GCC on x86-64; otherwise the macro is
+   ignored. */
+#ifdef POCKETFFT_RUNTIME_DISPATCH
+#if !(defined(__x86_64__) && defined(__GNUC__) && (__GNUC__>=6) \
+  && !defined(__clang__) && !defined(__INTEL_COMPILER)) \
+  || defined(__AVX512F__) || defined(POCKETFFT_NO_VECTORS)
+#undef POCKETFFT_RUNTIME_DISPATCH
+#endif
+#endif
+/* the name under which the header includes itself for runtime dispatch */
+#ifndef POCKETFFT_HEADER_NAME
+#define POCKETFFT_HEADER_NAME "pocketfft_hdronly.h"
+#endif
+#define POCKETFFT_FIRST_PASS
+
+namespace pocketfft {
+
+namespace detail {
+using std::size_t;
+using std::ptrdiff_t;
+
+// Always use std:: for <cmath> functions
+template <typename T> T cos(T) = delete;
+template <typename T> T sin(T) = delete;
+template <typename T> T sqrt(T) = delete;
+
+using shape_t = std::vector<size_t>;
+using stride_t = std::vector<ptrdiff_t>;
+
+constexpr bool FORWARD  = true,
+               BACKWARD = false;
+
+/* estimate: choose the algorithm for a 1D transform from a cost model
+             (deterministic, default)
+   measure:  time several candidate algorithms on this machine and keep the
+             fastest one */
+enum class planning_mode { estimate, measure };
+
+inline std::atomic<planning_mode> &planning_mode_setting()
+  {
+  static std::atomic<planning_mode> mode(planning_mode::estimate);
+  return mode;
+  }
+/* Only affects plans constructed afterwards; plans already in the cache are
+   kept. */
+inline void set_planning_mode(planning_mode mode)
+  { planning_mode_setting() = mode; }
+inline planning_mode get_planning_mode()
+  { return planning_mode_setting(); }
+
+/* real-valued outputs of r2c(): |X|^2, |X| or the natural logarithm of
+   |X|^2 for every complex coefficient X */
+enum class spectrum { power, magnitude, log_power };
+
+/* output region of convolve() and correlate(), per axis with input length na
+   and kernel length nb: full (na+nb-1 values), same (na values, centered
+   within the full result) or valid (na-nb+1 values not involving the zero
+   padding) */
+enum class conv_mode { full, same, valid };
+
+/* number of frames of length nperseg with hop size hop in a signal of length
+   len; trailing samples not covering a full frame are ignored */
+inline size_t stft_frames(size_t len, size_t nperseg, size_t hop)
+  {
+  if ((nperseg==0) || (hop==0))
+    throw std::invalid_argument("frame length and hop size must be positive");
+  return (len<nperseg) ? 0 : (len-nperseg)/hop + 1;
+  }
+
+#ifdef POCKETFFT_RUNTIME_DISPATCH
+#define POCKETFFT_ISA_LEVEL 0
+namespace isa_base {
+#include POCKETFFT_HEADER_NAME
+}
+#undef POCKETFFT_ISA_LEVEL
+
+#ifndef __AVX2__
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define POCKETFFT_ISA_LEVEL 1
+namespace isa_avx2 {
+#include POCKETFFT_HEADER_NAME
+}
+#undef POCKETFFT_ISA_LEVEL
+#pragma GCC pop_options
+#else
+namespace isa_avx2 = isa_base;
+#endif
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define POCKETFFT_ISA_LEVEL 2
+namespace isa_avx512 {
+#include POCKETFFT_HEADER_NAME
+}
+#undef POCKETFFT_ISA_LEVEL
+#pragma GCC pop_options
+#endif
+
+#endif // POCKETFFT_HDRONLY_H
+
+#if defined(POCKETFFT_ISA_LEVEL) \
+  || (defined(POCKETFFT_FIRST_PASS) && !defined(POCKETFFT_RUNTIME_DISPATCH))
+
 template<typename T> struct VLEN { static constexpr size_t val=1; };
 
+/* POCKETFFT_ISA_LEVEL is only defined while compiling for runtime dispatch */
 #ifndef POCKETFFT_NO_VECTORS
-#if (defined(__AVX512F__))
+#if (defined(__AVX512F__)) || (POCKETFFT_ISA_LEVEL+0==2)
 template<> struct VLEN<float> { static constexpr size_t val=16; };
 template<> struct VLEN<double> { static constexpr size_t val=8; };
-#elif (defined(__AVX__))
+#elif (defined(__AVX__)) || (POCKETFFT_ISA_LEVEL+0==1)
 template<> struct VLEN<float> { static constexpr size_t val=8; };
 template<> struct VLEN<double> { static constexpr size_t val=4; };
 #elif (defined(__SSE2__))
@@ -149,6 +261,24 @@ template<> struct VLEN<double> { static constexpr size_t val=2; };
 #endif
 #endif
 
+template<typename T> struct VTYPE {};
+template <typename T> using vtype_t = typename VTYPE<T>::type;
+
+#ifndef POCKETFFT_NO_VECTORS
+template<> struct VTYPE<float>
+  {
+  using type = float __attribute__ ((vector_size (VLEN<float>::val*sizeof(float))));
+  };
+template<> struct VTYPE<double>
+  {
+  using type = double __attribute__ ((vector_size (VLEN<double>::val*sizeof(double))));
+  };
+template<> struct VTYPE<long double>
+  {
+  using type = long double __attribute__ ((vector_size (VLEN<long double>::val*sizeof(long double))));
+  };
+#endif
+
 inline void *aligned_alloc(size_t align, size_t size)
   {
   align = std::max(align, alignof(max_align_t));
@@ -261,6 +391,11 @@ template<typename T> inline void PMINPLACE(T &a, T &b)
   { T t = a; a+=b; b=t-b; }
 template<typename T> inline void MPINPLACE(T &a, T &b)
   { T t = a; a-=b; b=t+b; }
+/* v*fct if `scale` is set, else v; the codelets use this to apply the
+   normalization factor while reading the input of the last pass */
+template<bool scale, typename T, typename T0> inline T scale_if(const T &v,
+  T0 fct)
+  { return scale ? T(v*fct) : v; }
 template<typename T> cmplx<T> conj(const cmplx<T> &a)
   { return {a.r, -a.i}; }
 template<bool fwd, typename T, typename T2> void special_mul (const cmplx<T> &v1, const cmplx<T2> &v2, cmplx<T> &res)
@@ -349,6 +484,9 @@ template<typename T> class sincos_2pibyn
       auto x1=v1[idx&mask], x2=v2[idx>>shift];
       return cmplx<T>(T(x1.r*x2.r-x1.i*x2.i), -T(x1.r*x2.i+x1.i*x2.r));
       }
+
+    size_t memory_size() const
+      { return (v1.size()+v2.size())*sizeof(cmplx<Thigh>); }
   };
 
 struct util // hack to avoid duplicate symbols
@@ -365,9 +503,19 @@ struct util // hack to avoid duplicate symbols
     return res;
     }
 
-  static POCKETFFT_NOINLINE double cost_guess (size_t n)
+  /* rough cost per point of a pass with the prime factor p in a transform of
+     length n; if `rader` is true, Rader's algorithm is assumed where it is
+     cheaper */
+  static POCKETFFT_NOINLINE double factor_cost (size_t p, size_t n, bool rader)
     {
     constexpr double lfp=1.1; // penalty for non-hardcoded larger factors
+    if (p<=5) return double(p);
+    if (rader && rader_preferred(p, n)) return rader_cost(p, n);
+    return lfp*double(p);
+    }
+
+  static POCKETFFT_NOINLINE double cost_guess (size_t n, bool rader=false)
+    {
     size_t ni=n;
     double result=0.;
     while ((n&1)==0)
@@ -375,13 +523,61 @@ struct util // hack to avoid duplicate symbols
     for (size_t x=3; x*x<=n; x+=2)
       while ((n%x)==0)
         {
-        result+= (x<=5) ? double(x) : lfp*double(x); // penalize larger prime factors
+        result+=factor_cost(x, ni, rader);
         n/=x;
         }
-    if (n>1) result+=(n<=5) ? double(n) : lfp*double(n);
+    if (n>1) result+=factor_cost(n, ni, rader);
     return result*double(ni);
     }
 
+  /* Rader's algorithm is used for prime factors without a codelet; the
+     limit keeps the index arithmetic within 64 bits */
+  static bool rader_possible (size_t p)
+    {
+    return (p>11) && (std::uint64_t(p)<(std::uint64_t(1)<<32))
+      && (largest_prime_factor(p)==p);
+    }
+  /* rough cost per point of a radix-p pass computed with Rader's algorithm in
+     a transform of length n: two FFTs of length p-1, plus an overhead for
+     gathering, scattering and the products which was fitted to timings. The
+     overhead is larger for n>p, since the generic pass then works on many
+     butterflies at once and is comparatively faster. */
+  static POCKETFFT_NOINLINE double rader_cost (size_t p, size_t n)
+    {
+    return 2*cost_guess(p-1, true)/double(p)
+         + double(std::min<size_t>(43, 6*(n/p)));
+    }
+  static bool rader_preferred (size_t p, size_t n)
+    { return rader_possible(p) && (rader_cost(p, n)<factor_cost(p, n, false)); }
+
+  static std::uint64_t powmod (std::uint64_t b, std::uint64_t e, std::uint64_t m)
+    {
+    std::uint64_t res=1;
+    for (b%=m; e!=0; e>>=1, b=(b*b)%m)
+      if (e&1) res=(res*b)%m;
+    return res;
+    }
+  /* smallest generator of the multiplicative group modulo the prime p */
+  static POCKETFFT_NOINLINE size_t primitive_root (size_t p)
+    {
+    std::vector<size_t> fct;
+    size_t n=p-1;
+    for (size_t x=2; x*x<=n; ++x)
+      if ((n%x)==0)
+        {
+        fct.push_back(x);
+        while ((n%x)==0) n/=x;
+        }
+    if (n>1) fct.push_back(n);
+    for (size_t g=2; ; ++g)
+      {
+      bool ok=true;
+      for (auto f: fct)
+        if (powmod(g, (p-1)/f, p)==1) { ok=false; break; }
+      if (ok) return g;
+      }
+    }
+
   /* returns the smallest composite of 2, 3, 5, 7 and 11 which is >= n */
   static POCKETFFT_NOINLINE size_t good_size_cmplx(size_t n)
     {
@@ -483,6 +679,8 @@ struct util // hack to avoid duplicate symbols
   static size_t thread_count (size_t /*nthreads*/, const shape_t &/*shape*/,
     size_t /*axis*/, size_t /*vlen*/)
     { return 1; }
+  static size_t inner_thread_count (size_t /*nthreads*/, size_t /*outer*/)
+    { return 1; }
 #else
   static size_t thread_count (size_t nthreads, const shape_t &shape,
     size_t axis, size_t vlen)
@@ -496,6 +694,11 @@ struct util // hack to avoid duplicate symbols
       std::thread::hardware_concurrency() : nthreads;
     return std::max(size_t(1), std::min(parallel, max_threads));
     }
+  /* Threads available to each single transform if `outer` threads work on
+     different lines. Nested parallel regions are avoided, so only a
+     transform running on the calling thread gets more than one. */
+  static size_t inner_thread_count (size_t nthreads, size_t outer)
+    { return (outer==1) ? nthreads : 1; }
 #endif
   };
 
@@ -804,6 +1007,137 @@ void thread_map(size_t nthreads, Func f)
 
 }
 
+//
+// plan serialization helpers
+//
+
+/* Appends plan data to a byte buffer. Arrays are aligned to 64 bytes relative
+   to the start of the buffer. */
+class plan_writer
+  {
+  private:
+    std::vector<char> buf;
+
+  public:
+    template<typename T> void put(const T &val)
+      {
+      auto p = reinterpret_cast<const char *>(&val);
+      buf.insert(buf.end(), p, p+sizeof(T));
+      }
+    void put_size(size_t val) { put(std::uint64_t(val)); }
+    void align(size_t alignment=64)
+      { buf.resize((buf.size()+alignment-1)/alignment*alignment, 0); }
+    template<typename T> void put_array(const T *data, size_t n)
+      {
+      put_size(n);
+      align();
+      auto p = reinterpret_cast<const char *>(data);
+      buf.insert(buf.end(), p, p+n*sizeof(T));
+      }
+    const std::vector<char> &data() const { return buf; }
+  };
+
+/* Reads plan data from a memory region written by plan_writer. Arrays are not
+   copied; the plans reference them directly and keep the region alive via
+   keepalive(). */
+class plan_reader
+  {
+  private:
+    const char *base;
+    size_t pos, end;
+    std::shared_ptr<const void> keep;
+
+    void need(size_t nbytes) const
+      {
+      if (nbytes>end-pos)
+        throw std::runtime_error("corrupt plan data");
+      }
+
+  public:
+    plan_reader(const char *base_, size_t begin_, size_t end_,
+      std::shared_ptr<const void> keep_)
+      : base(base_), pos(begin_), end(end_), keep(keep_) {}
+
+    template<typename T> T get()
+      {
+      need(sizeof(T));
+      T res;
+      std::memcpy(&res, base+pos, sizeof(T));
+      pos += sizeof(T);
+      return res;
+      }
+    size_t get_size()
+      {
+      auto res = get<std::uint64_t>();
+      if (res>std::numeric_limits<size_t>::max())
+        throw std::runtime_error("corrupt plan data");
+      return size_t(res);
+      }
+    template<typename T> T *get_array(size_t n)
+      {
+      if (get_size()!=n)
+        throw std::runtime_error("corrupt plan data");
+      pos = std::min(end, (pos+63)/64*64);
+      if (n>std::numeric_limits<size_t>::max()/sizeof(T))
+        throw std::runtime_error("corrupt plan data");
+      need(n*sizeof(T));
+      // plans never write to their twiddle factors after construction
+      auto res = reinterpret_cast<T *>(const_cast<char *>(base+pos));
+      pos += n*sizeof(T);
+      return res;
+      }
+    const std::shared_ptr<const void> &keepalive() const { return keep; }
+  };
+
+/* Chooses the buffers for the passes of cfftp and rfftp such that the last
+   pass writes to `out`, so no final copy is needed. The data alternate
+   between `out` and `buf`; `buf2` is only used by in-place transforms
+   (in==out) with an odd number (>1) of passes that move the data. `in` is
+   never written to unless in==out. */
+template<typename T> class pass_buffers
+  {
+  private:
+    const T *src_;
+    T *out, *buf, *buf2;
+    size_t len, left;
+
+  public:
+    pass_buffers(const T *in, T *out_, T *buf_, T *buf2_, size_t len_,
+      size_t nmove)
+      : src_(in), out(out_), buf(buf_), buf2(buf2_), len(len_), left(nmove) {}
+
+    /* current location of the data */
+    const T *src() const { return src_; }
+    /* destination of the next pass that moves the data */
+    T *dst()
+      {
+      T *res = (left&1) ? out : buf;
+      if (res==src_) // first pass of an in-place transform
+        {
+        if (left>1)
+          res = buf2;
+        else
+          { std::copy_n(src_, len, buf); src_=buf; }
+        }
+      return res;
+      }
+    void moved(T *dst_) { src_=dst_; --left; }
+    /* current location of the data, which the next pass may overwrite;
+       copies `in` if necessary */
+    T *writable()
+      {
+      if ((src_!=out) && (src_!=buf) && (src_!=buf2))
+        {
+        T *res = (left&1) ? buf : out;
+        std::copy_n(src_, len, res);
+        src_ = res;
+        }
+      return const_cast<T *>(src_);
+      }
+    /* scratch buffer for passes that leave their result in place */
+    T *scratch() const { return (src_==buf) ? out : buf; }
+  };
+
 //
 // complex FFTPACK transforms
 //
@@ -814,24 +1148,29 @@ template<typename T0> class cfftp
     struct fctdata
       {
       size_t fct;
+      bool rader; // computed with Rader's algorithm
       cmplx<T0> *tw, *tws;
+      std::unique_ptr<cfftp> rplan; // plan of length fct-1 (Rader only)
+      arr<size_t> perm; // g^q and g^-q mod fct (Rader only)
       };
 
     size_t length;
     arr<cmplx<T0>> mem;
+    cmplx<T0> *twd; // start of the twiddle factors
+    std::shared_ptr<const void> ext; // owner of twd, if not stored in mem
     std::vector<fctdata> fact;
 
-    void add_factor(size_t factor)
-      { fact.push_back({factor, nullptr, nullptr}); }
+    void add_factor(size_t factor, bool rader=false)
+      { fact.push_back({factor, rader, nullptr, nullptr, nullptr, arr<size_t>()}); }
 
-template<bool fwd, typename T> void pass2 (size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass2 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+2*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+2*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -871,17 +1210,17 @@ template<bool fwd, typename T> void pass2 (size_t ido, size_t l1,
         special_mul<fwd>(ca+cb,WA(u1-1,i),CH(i,k,u1)); \
         special_mul<fwd>(ca-cb,WA(u2-1,i),CH(i,k,u2)); \
         }
-template<bool fwd, typename T> void pass3 (size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass3 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 tw1r=-0.5,
                tw1i= (fwd ? -1: 1) * T0(0.8660254037844386467637231707529362L);
 
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+3*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+3*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -910,14 +1249,14 @@ template<bool fwd, typename T> void pass3 (size_t ido, size_t l1,
 #undef POCKETFFT_PARTSTEP3a
 #undef POCKETFFT_PREP3
 
-template<bool fwd, typename T> void pass4 (size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass4 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+4*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+4*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -984,9 +1323,9 @@ template<bool fwd, typename T> void pass4 (size_t ido, size_t l1,
         special_mul<fwd>(ca+cb,WA(u1-1,i),CH(i,k,u1)); \
         special_mul<fwd>(ca-cb,WA(u2-1,i),CH(i,k,u2)); \
         }
-template<bool fwd, typename T> void pass5 (size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass5 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 tw1r= T0(0.3090169943749474241022934171828191L),
                tw1i= (fwd ? -1: 1) * T0(0.9510565162951535721164393333793821L),
@@ -995,8 +1334,8 @@ template<bool fwd, typename T> void pass5 (size_t ido, size_t l1,
 
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+5*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+5*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -1055,9 +1394,9 @@ template<bool fwd, typename T> void pass5 (size_t ido, size_t l1,
         special_mul<fwd>(db,WA(u2-1,i),CH(i,k,u2)); \
         }
 
-template<bool fwd, typename T> void pass7(size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass7(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 tw1r= T0(0.6234898018587335305250048840042398L),
                tw1i= (fwd ? -1 : 1) * T0(0.7818314824680298087084445266740578L),
@@ -1068,8 +1407,8 @@ template<bool fwd, typename T> void pass7(size_t ido, size_t l1,
 
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+7*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+7*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -1122,14 +1461,14 @@ template <bool fwd, typename T> void ROTX135(T &a) const
     { auto tmp_=a.r; a.r=hsqt2*(-a.r-a.i); a.i=hsqt2*(tmp_-a.i); }
   }
 
-template<bool fwd, typename T> void pass8 (size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass8 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+8*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+8*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -1206,6 +1545,169 @@ template<bool fwd, typename T> void pass8 (size_t ido, size_t l1,
       }
    }
 
+/* in-place 4-point DFT */
+template<bool fwd, typename T> void dft4 (T &a0, T &a1, T &a2, T &a3) const
+  {
+  T t1, t2, t3, t4;
+  PM(t2,t1,a0,a2);
+  PM(t3,t4,a1,a3);
+  ROTX90<fwd>(t4);
+  PM(a0,a2,t2,t3);
+  PM(a1,a3,t1,t4);
+  }
+
+/* 16-point DFT of CC(idx,j0+js*j,k) as 4x4; output j ends up in
+   a<4*(j&3)+(j>>2)> */
+#define POCKETFFT_PREP16(a,idx,j0,js) \
+        T a##0=CC(idx,j0,k), a##1=CC(idx,j0+js,k), a##2=CC(idx,j0+2*js,k), \
+          a##3=CC(idx,j0+3*js,k), a##4=CC(idx,j0+4*js,k), \
+          a##5=CC(idx,j0+5*js,k), a##6=CC(idx,j0+6*js,k), \
+          a##7=CC(idx,j0+7*js,k), a##8=CC(idx,j0+8*js,k), \
+          a##9=CC(idx,j0+9*js,k), a##10=CC(idx,j0+10*js,k), \
+          a##11=CC(idx,j0+11*js,k), a##12=CC(idx,j0+12*js,k), \
+          a##13=CC(idx,j0+13*js,k), a##14=CC(idx,j0+14*js,k), \
+          a##15=CC(idx,j0+15*js,k); \
+        dft4<fwd>(a##0,a##4,a##8,a##12); \
+        dft4<fwd>(a##1,a##5,a##9,a##13); \
+        dft4<fwd>(a##2,a##6,a##10,a##14); \
+        dft4<fwd>(a##3,a##7,a##11,a##15); \
+        special_mul<fwd>(a##5,cmplx<T0>(c16,s16),a##5); \
+        ROTX45<fwd>(a##6); \
+        special_mul<fwd>(a##7,cmplx<T0>(s16,c16),a##7); \
+        ROTX45<fwd>(a##9); \
+        ROTX90<fwd>(a##10); \
+        ROTX135<fwd>(a##11); \
+        special_mul<fwd>(a##13,cmplx<T0>(s16,c16),a##13); \
+        ROTX135<fwd>(a##14); \
+        special_mul<fwd>(a##15,cmplx<T0>(-c16,-s16),a##15); \
+        dft4<fwd>(a##0,a##1,a##2,a##3); \
+        dft4<fwd>(a##4,a##5,a##6,a##7); \
+        dft4<fwd>(a##8,a##9,a##10,a##11); \
+        dft4<fwd>(a##12,a##13,a##14,a##15);
+
+#define POCKETFFT_OUT16(a,j0) \
+        CH(0,k,j0   )=a##0;  CH(0,k,j0+ 1)=a##4;  CH(0,k,j0+ 2)=a##8; \
+        CH(0,k,j0+ 3)=a##12; CH(0,k,j0+ 4)=a##1;  CH(0,k,j0+ 5)=a##5; \
+        CH(0,k,j0+ 6)=a##9;  CH(0,k,j0+ 7)=a##13; CH(0,k,j0+ 8)=a##2; \
+        CH(0,k,j0+ 9)=a##6;  CH(0,k,j0+10)=a##10; CH(0,k,j0+11)=a##14; \
+        CH(0,k,j0+12)=a##3;  CH(0,k,j0+13)=a##7;  CH(0,k,j0+14)=a##11; \
+        CH(0,k,j0+15)=a##15;
+
+/* like POCKETFFT_OUT16 with twiddles, but without output j0 */
+#define POCKETFFT_OUTTW16(a,j0) \
+        special_mul<fwd>(a##4 ,WA(j0   ,i),CH(i,k,j0+ 1)); \
+        special_mul<fwd>(a##8 ,WA(j0+ 1,i),CH(i,k,j0+ 2)); \
+        special_mul<fwd>(a##12,WA(j0+ 2,i),CH(i,k,j0+ 3)); \
+        special_mul<fwd>(a##1 ,WA(j0+ 3,i),CH(i,k,j0+ 4)); \
+        special_mul<fwd>(a##5 ,WA(j0+ 4,i),CH(i,k,j0+ 5)); \
+        special_mul<fwd>(a##9 ,WA(j0+ 5,i),CH(i,k,j0+ 6)); \
+        special_mul<fwd>(a##13,WA(j0+ 6,i),CH(i,k,j0+ 7)); \
+        special_mul<fwd>(a##2 ,WA(j0+ 7,i),CH(i,k,j0+ 8)); \
+        special_mul<fwd>(a##6 ,WA(j0+ 8,i),CH(i,k,j0+ 9)); \
+        special_mul<fwd>(a##10,WA(j0+ 9,i),CH(i,k,j0+10)); \
+        special_mul<fwd>(a##14,WA(j0+10,i),CH(i,k,j0+11)); \
+        special_mul<fwd>(a##3 ,WA(j0+11,i),CH(i,k,j0+12)); \
+        special_mul<fwd>(a##7 ,WA(j0+12,i),CH(i,k,j0+13)); \
+        special_mul<fwd>(a##11,WA(j0+13,i),CH(i,k,j0+14)); \
+        special_mul<fwd>(a##15,WA(j0+14,i),CH(i,k,j0+15));
+
+template<bool fwd, bool scale, typename T> void pass16 (size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 c16=T0(0.923879532511286756128183189396788L),
+               s16=T0(0.382683432365089771728459984030399L);
+
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+16*c)], fct); };
+  auto WA = [wa, ido](size_t x, size_t i)
+    { return wa[i-1+x*(ido-1)]; };
+
+  for (size_t k=0; k<l1; ++k)
+    {
+    {
+    POCKETFFT_PREP16(a,0,0,1)
+    POCKETFFT_OUT16(a,0)
+    }
+    for (size_t i=1; i<ido; ++i)
+      {
+      POCKETFFT_PREP16(a,i,0,1)
+      CH(i,k,0) = a0;
+      POCKETFFT_OUTTW16(a,0)
+      }
+    }
+  }
+
+/* 32-point DFT as 2x16: 16-point DFTs of the even (e) and odd (o) inputs,
+   then w32^j applied to o<j> and a final radix-2 step */
+#define POCKETFFT_PREP32(idx) \
+        POCKETFFT_PREP16(e,idx,0,2) \
+        POCKETFFT_PREP16(o,idx,1,2) \
+        special_mul<fwd>(o4 ,cmplx<T0>( c32, s32),o4 ); \
+        special_mul<fwd>(o8 ,cmplx<T0>( c16, s16),o8 ); \
+        special_mul<fwd>(o12,cmplx<T0>( c3, s3),o12); \
+        ROTX45<fwd>(o1); \
+        special_mul<fwd>(o5 ,cmplx<T0>( s3, c3),o5 ); \
+        special_mul<fwd>(o9 ,cmplx<T0>( s16, c16),o9 ); \
+        special_mul<fwd>(o13,cmplx<T0>( s32, c32),o13); \
+        ROTX90<fwd>(o2); \
+        special_mul<fwd>(o6 ,cmplx<T0>(-s32, c32),o6 ); \
+        special_mul<fwd>(o10,cmplx<T0>(-s16, c16),o10); \
+        special_mul<fwd>(o14,cmplx<T0>(-s3, c3),o14); \
+        ROTX135<fwd>(o3); \
+        special_mul<fwd>(o7 ,cmplx<T0>(-c3, s3),o7 ); \
+        special_mul<fwd>(o11,cmplx<T0>(-c16, s16),o11); \
+        special_mul<fwd>(o15,cmplx<T0>(-c32, s32),o15); \
+        PMINPLACE(e0,o0); PMINPLACE(e1,o1); PMINPLACE(e2,o2); \
+        PMINPLACE(e3,o3); PMINPLACE(e4,o4); PMINPLACE(e5,o5); \
+        PMINPLACE(e6,o6); PMINPLACE(e7,o7); PMINPLACE(e8,o8); \
+        PMINPLACE(e9,o9); PMINPLACE(e10,o10); PMINPLACE(e11,o11); \
+        PMINPLACE(e12,o12); PMINPLACE(e13,o13); PMINPLACE(e14,o14); \
+        PMINPLACE(e15,o15);
+
+template<bool fwd, bool scale, typename T> void pass32 (size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 c16=T0(0.923879532511286756128183189396788L),
+               s16=T0(0.382683432365089771728459984030399L),
+               c32=T0(0.980785280403230449126182236134239L),
+               s32=T0(0.195090322016128267848284868477022L),
+               c3=T0(0.831469612302545237078788377617906L),
+               s3=T0(0.555570233019602224742830813948533L);
+
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+32*c)], fct); };
+  auto WA = [wa, ido](size_t x, size_t i)
+    { return wa[i-1+x*(ido-1)]; };
+
+  for (size_t k=0; k<l1; ++k)
+    {
+    {
+    POCKETFFT_PREP32(0)
+    POCKETFFT_OUT16(e,0)
+    POCKETFFT_OUT16(o,16)
+    }
+    for (size_t i=1; i<ido; ++i)
+      {
+      POCKETFFT_PREP32(i)
+      CH(i,k,0) = e0;
+      POCKETFFT_OUTTW16(e,0)
+      special_mul<fwd>(o0,WA(15,i),CH(i,k,16));
+      POCKETFFT_OUTTW16(o,16)
+      }
+    }
+  }
+
+#undef POCKETFFT_PREP32
+#undef POCKETFFT_OUTTW16
+#undef POCKETFFT_OUT16
+#undef POCKETFFT_PREP16
+
 
 #define POCKETFFT_PREP11(idx) \
         T t1 = CC(idx,0,k), t2, t3, t4, t5, t6, t7, t8, t9, t10, t11; \
@@ -1235,9 +1737,9 @@ template<bool fwd, typename T> void pass8 (size_t ido, size_t l1,
         special_mul<fwd>(db,WA(u2-1,i),CH(i,k,u2)); \
         }
 
-template<bool fwd, typename T> void pass11 (size_t ido, size_t l1,
+template<bool fwd, bool scale, typename T> void pass11 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const cmplx<T0> * POCKETFFT_RESTRICT wa) const
+  const cmplx<T0> * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 tw1r= T0(0.8412535328311811688618116489193677L),
                tw1i= (fwd ? -1 : 1) * T0(0.5406408174555975821076359543186917L),
@@ -1252,8 +1754,8 @@ template<bool fwd, typename T> void pass11 (size_t ido, size_t l1,
 
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+11*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+11*c)], fct); };
   auto WA = [wa, ido](size_t x, size_t i)
     { return wa[i-1+x*(ido-1)]; };
 
@@ -1315,10 +1817,8 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
   auto CH2 = [ch, idl1](size_t a, size_t b) -> const T&
     { return ch[a+idl1*b]; };
 
-  arr<cmplx<T0>> wal(ip);
-  wal[0] = cmplx<T0>(1., 0.);
-  for (size_t i=1; i<ip; ++i)
-    wal[i]=cmplx<T0>(csarr[i].r,fwd ? -csarr[i].i : csarr[i].i);
+  auto wal = [csarr](size_t i)
+    { return cmplx<T0>(csarr[i].r, fwd ? -csarr[i].i : csarr[i].i); };
 
   for (size_t k=0; k<l1; ++k)
     for (size_t i=0; i<ido; ++i)
@@ -1338,12 +1838,13 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
   for (size_t l=1, lc=ip-1; l<ipph; ++l, --lc)
     {
     // j=0
+    cmplx<T0> wal1=wal(l), wal2=wal(2*l);
     for (size_t ik=0; ik<idl1; ++ik)
       {
-      CX2(ik,l).r = CH2(ik,0).r+wal[l].r*CH2(ik,1).r+wal[2*l].r*CH2(ik,2).r;
-      CX2(ik,l).i = CH2(ik,0).i+wal[l].r*CH2(ik,1).i+wal[2*l].r*CH2(ik,2).i;
-      CX2(ik,lc).r=-wal[l].i*CH2(ik,ip-1).i-wal[2*l].i*CH2(ik,ip-2).i;
-      CX2(ik,lc).i=wal[l].i*CH2(ik,ip-1).r+wal[2*l].i*CH2(ik,ip-2).r;
+      CX2(ik,l).r = CH2(ik,0).r+wal1.r*CH2(ik,1).r+wal2.r*CH2(ik,2).r;
+      CX2(ik,l).i = CH2(ik,0).i+wal1.r*CH2(ik,1).i+wal2.r*CH2(ik,2).i;
+      CX2(ik,lc).r=-wal1.i*CH2(ik,ip-1).i-wal2.i*CH2(ik,ip-2).i;
+      CX2(ik,lc).i=wal1.i*CH2(ik,ip-1).r+wal2.i*CH2(ik,ip-2).r;
       }
 
     size_t iwal=2*l;
@@ -1351,9 +1852,9 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     for (; j<ipph-1; j+=2, jc-=2)
       {
       iwal+=l; if (iwal>ip) iwal-=ip;
-      cmplx<T0> xwal=wal[iwal];
+      cmplx<T0> xwal=wal(iwal);
       iwal+=l; if (iwal>ip) iwal-=ip;
-      cmplx<T0> xwal2=wal[iwal];
+      cmplx<T0> xwal2=wal(iwal);
       for (size_t ik=0; ik<idl1; ++ik)
         {
         CX2(ik,l).r += CH2(ik,j).r*xwal.r+CH2(ik,j+1).r*xwal2.r;
@@ -1365,7 +1866,7 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     for (; j<ipph; ++j, --jc)
       {
       iwal+=l; if (iwal>ip) iwal-=ip;
-      cmplx<T0> xwal=wal[iwal];
+      cmplx<T0> xwal=wal(iwal);
       for (size_t ik=0; ik<idl1; ++ik)
         {
         CX2(ik,l).r += CH2(ik,j).r*xwal.r;
@@ -1404,80 +1905,251 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     }
   }
 
-template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
+/* Rader's algorithm: for prime ip, the DFT of the inputs CC(i,1..ip-1,k) is a
+   cyclic convolution of length ip-1 once inputs and outputs are permuted by
+   powers of a generator g. The Fourier transformed and normalized kernel is
+   stored in f.tws. */
+template<bool fwd, typename T> void passr (size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const fctdata &f, T * POCKETFFT_RESTRICT buf) const
+  {
+  const size_t cdim=f.fct, nr=cdim-1, h=nr/2;
+
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,cdim](size_t a, size_t b, size_t c) -> const T&
+    { return cc[a+ido*(b+cdim*c)]; };
+  auto WA = [&f, ido](size_t x, size_t i)
+    { return f.tw[i-1+x*(ido-1)]; };
+
+  const size_t *iperm=f.perm.data(), *operm=iperm+nr;
+  T *a=buf, *scratch=buf+nr;
+  for (size_t k=0; k<l1; ++k)
+    for (size_t i=0; i<ido; ++i)
+      {
+      T x0=CC(i,0,k);
+      for (size_t q=0; q<nr; ++q)
+        a[q]=CC(i,iperm[q],k);
+      f.rplan->exec(a, T0(1), true, scratch);
+      CH(i,k,0)=x0+a[0];
+      for (size_t q=0; q<nr; ++q)
+        a[q]*=f.tws[q];
+      a[0]+=x0; // adds x0 to all outputs
+      f.rplan->exec(a, T0(1), false, scratch);
+      /* the backward transform is the forward one with negated output
+         indices, and -1 = g^(nr/2) */
+      for (size_t m=0; m<nr; ++m)
+        {
+        size_t j=operm[fwd ? m : ((m<h) ? m+h : m-h)];
+        if (i==0)
+          CH(i,k,j)=a[m];
+        else
+          special_mul<fwd>(a[m],WA(j-1,i),CH(i,k,j));
+        }
+      }
+  }
+
+/* runs the pass for factor fact[k1] if there is a codelet for it */
+template<bool fwd, bool scale, typename T> bool pass_codelet(size_t k1,
+  size_t ido, size_t l1, const T *p1, T *p2, T0 fct) const
+  {
+  const auto *tw = fact[k1].tw;
+  switch (fact[k1].fct)
+    {
+    case 4: pass4<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 8: pass8<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 16: pass16<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 32: pass32<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 2: pass2<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 3: pass3<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 5: pass5<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 7: pass7<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    case 11: pass11<fwd, scale>(ido, l1, p1, p2, tw, fct); return true;
+    default: return false;
+    }
+  }
+
+/* number of passes that move the data to another buffer; generic passes
+   leave their result in place */
+size_t moving_passes() const
+  {
+  size_t res=0;
+  for (const auto &f: fact)
+    if (f.rader || has_codelet(f.fct)) ++res;
+  return res;
+  }
+/* elements of scratch space needed before the one of Rader passes */
+size_t pass_buffer_size() const
+  {
+  size_t nmove=moving_passes();
+  return ((nmove>1) && (nmove&1)) ? 2*length : length;
+  }
+
+/* The factor fct is applied by the last pass that has a codelet, so that
+   normalized transforms need no extra sweep over the data; only transforms
+   consisting of generic or Rader passes scale at the end. */
+template<bool fwd, typename T> void pass_all(const T *in, T *out, T0 fct,
+  T *buf) const
   {
-  if (length==1) { c[0]*=fct; return; }
+  if (length==1) { out[0]=in[0]*fct; return; }
   size_t l1=1;
-  arr<T> ch(length);
-  T *p1=c, *p2=ch.data();
+  pass_buffers<T> pb(in, out, buf, buf+length, length, moving_passes());
+  T *rbuf = buf+pass_buffer_size();
+  size_t kscale=fact.size();
+  if (fct!=1.)
+    for (size_t k=fact.size(); k>0; --k)
+      if (has_codelet(fact[k-1].fct)) { kscale=k-1; break; }
 
   for(size_t k1=0; k1<fact.size(); k1++)
     {
     size_t ip=fact[k1].fct;
     size_t l2=ip*l1;
     size_t ido = length/l2;
-    if     (ip==4)
-      pass4<fwd> (ido, l1, p1, p2, fact[k1].tw);
-    else if(ip==8)
-      pass8<fwd>(ido, l1, p1, p2, fact[k1].tw);
-    else if(ip==2)
-      pass2<fwd>(ido, l1, p1, p2, fact[k1].tw);
-    else if(ip==3)
-      pass3<fwd> (ido, l1, p1, p2, fact[k1].tw);
-    else if(ip==5)
-      pass5<fwd> (ido, l1, p1, p2, fact[k1].tw);
-    else if(ip==7)
-      pass7<fwd> (ido, l1, p1, p2, fact[k1].tw);
-    else if(ip==11)
-      pass11<fwd> (ido, l1, p1, p2, fact[k1].tw);
+    if (has_codelet(ip))
+      {
+      T *p2=pb.dst();
+      if (k1==kscale)
+        pass_codelet<fwd, true>(k1, ido, l1, pb.src(), p2, fct);
+      else
+        pass_codelet<fwd, false>(k1, ido, l1, pb.src(), p2, fct);
+      pb.moved(p2);
+      }
+    else if(fact[k1].rader)
+      {
+      T *p2=pb.dst();
+      passr<fwd>(ido, l1, pb.src(), p2, fact[k1], rbuf);
+      pb.moved(p2);
+      }
     else
       {
-      passg<fwd>(ido, ip, l1, p1, p2, fact[k1].tw, fact[k1].tws);
-      std::swap(p1,p2);
+      T *p1=pb.writable();
+      passg<fwd>(ido, ip, l1, p1, pb.scratch(), fact[k1].tw, fact[k1].tws);
       }
-    std::swap(p1,p2);
     l1=l2;
     }
-  if (p1!=c)
-    {
-    if (fct!=1.)
-      for (size_t i=0; i<length; ++i)
-        c[i] = ch[i]*fct;
-    else
-      std::copy_n (p1, length, c);
-    }
-  else
-    if (fct!=1.)
-      for (size_t i=0; i<length; ++i)
-        c[i] *= fct;
+  if (kscale==fact.size() && (fct!=1.))
+    for (size_t i=0; i<length; ++i)
+      out[i]*=fct;
   }
 
   public:
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
+      {
+      size_t res=0;
+      for (const auto &f: fact)
+        if (f.rader)
+          res=std::max(res, f.fct-1+f.rplan->workspace_size());
+      return pass_buffer_size()+res;
+      }
+
+    template<typename T> void exec(T c[], T0 fct, bool fwd, T *buf) const
+      { exec(c, c, fct, fwd, buf); }
+    /* out-of-place variant; in may be equal to out */
+    template<typename T> void exec(const T in[], T out[], T0 fct, bool fwd,
+      T *buf) const
+      {
+      fwd ? pass_all<true>(in, out, fct, buf)
+          : pass_all<false>(in, out, fct, buf);
+      }
     template<typename T> void exec(T c[], T0 fct, bool fwd) const
-      { fwd ? pass_all<true>(c, fct) : pass_all<false>(c, fct); }
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, fwd, buf.data());
+      }
 
-  private:
-    POCKETFFT_NOINLINE void factorize()
+    /* default factorization used by the constructor; powers of two are
+       split into factors of at most `maxpow2` (4, 8, 16 or 32). By default,
+       radix 16 is only used while the data fits into L1 cache; for larger
+       arrays the 32 concurrent memory streams of pass16 make radix 8
+       faster on scalar data. */
+    static POCKETFFT_NOINLINE std::vector<size_t> factorize(size_t len,
+      size_t maxpow2=0)
       {
-      size_t len=length;
-      while ((len&7)==0)
-        { add_factor(8); len>>=3; }
-      while ((len&3)==0)
-        { add_factor(4); len>>=2; }
+      if (maxpow2==0)
+        maxpow2 = (len*sizeof(cmplx<T0>)<=32768) ? 16 : 8;
+      std::vector<size_t> res;
+      for (size_t ip=maxpow2; ip>=4; ip>>=1)
+        while ((len&(ip-1))==0)
+          { res.push_back(ip); len/=ip; }
       if ((len&1)==0)
         {
         len>>=1;
         // factor 2 should be at the front of the factor list
-        add_factor(2);
-        std::swap(fact[0].fct, fact.back().fct);
+        res.push_back(2);
+        std::swap(res[0], res.back());
         }
       for (size_t divisor=3; divisor*divisor<=len; divisor+=2)
         while ((len%divisor)==0)
           {
-          add_factor(divisor);
+          res.push_back(divisor);
           len/=divisor;
           }
-      if (len>1) add_factor(len);
+      if (len>1) res.push_back(len);
+      return res;
+      }
+
+  private:
+    static bool has_codelet(size_t ip)
+      {
+      return (ip==2) || (ip==3) || (ip==4) || (ip==5) || (ip==7) || (ip==8)
+        || (ip==11) || (ip==16) || (ip==32);
+      }
+
+    bool factors_valid() const
+      {
+      size_t prod=1;
+      for (const auto &f: fact)
+        {
+        size_t ip=f.fct;
+        if ((ip<2) || (((ip&1)==0) && ((ip&(ip-1))!=0 || ip>32))
+          || (length%(prod*ip)!=0) || (f.rader && !util::rader_possible(ip)))
+          return false;
+        prod*=ip;
+        }
+      return prod==length;
+      }
+
+    /* index permutations for Rader's algorithm */
+    static void comp_rader_perm(fctdata &f)
+      {
+      size_t ip=f.fct, nr=ip-1;
+      std::uint64_t g=util::primitive_root(ip), ginv=util::powmod(g, ip-2, ip);
+      f.perm.resize(2*nr);
+      std::uint64_t x=1, y=1;
+      for (size_t q=0; q<nr; ++q)
+        {
+        f.perm[q]=size_t(x);
+        f.perm[nr+q]=size_t(y);
+        x=(x*g)%ip;
+        y=(y*ginv)%ip;
+        }
+      }
+
+    /* forward transform of w^(g^-q), including the 1/(ip-1) of the inverse
+       transform; computed in at least double precision, since errors in the
+       kernel add up when Rader passes are nested */
+    static void comp_rader_kernel(fctdata &f)
+      {
+      using Thigh = typename std::conditional<(sizeof(T0)>sizeof(double)), T0, double>::type;
+      size_t nr=f.fct-1;
+      sincos_2pibyn<Thigh> twiddle(f.fct);
+      arr<cmplx<Thigh>> tmp(nr);
+      for (size_t q=0; q<nr; ++q)
+        tmp[q] = conj(twiddle[f.perm[nr+q]]);
+      cfftp<Thigh>(nr).exec(tmp.data(), Thigh(1)/Thigh(nr), true);
+      for (size_t q=0; q<nr; ++q)
+        f.tws[q].Set(T0(tmp[q].r), T0(tmp[q].i));
+      }
+
+    void init_rader()
+      {
+      for (auto &f: fact)
+        if (f.rader)
+          {
+          comp_rader_perm(f);
+          f.rplan=std::unique_ptr<cfftp>(new cfftp(f.fct-1));
+          }
       }
 
     size_t twsize() const
@@ -1487,47 +2159,139 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
         {
         size_t ip=fact[k].fct, ido= length/(l1*ip);
         twsize+=(ip-1)*(ido-1);
-        if (ip>11)
+        if (fact[k].rader)
+          twsize+=ip-1;
+        else if ((ip>11) && (ip&1))
           twsize+=ip;
         l1*=ip;
         }
       return twsize;
       }
 
-    void comp_twiddle()
+    void assign_twiddle()
       {
-      sincos_2pibyn<T0> twiddle(length);
       size_t l1=1;
       size_t memofs=0;
       for (size_t k=0; k<fact.size(); ++k)
         {
         size_t ip=fact[k].fct, ido=length/(l1*ip);
-        fact[k].tw=mem.data()+memofs;
+        fact[k].tw=twd+memofs;
         memofs+=(ip-1)*(ido-1);
-        for (size_t j=1; j<ip; ++j)
-          for (size_t i=1; i<ido; ++i)
-            fact[k].tw[(j-1)*(ido-1)+i-1] = twiddle[j*l1*i];
-        if (ip>11)
+        if (fact[k].rader || ((ip>11) && (ip&1)))
           {
-          fact[k].tws=mem.data()+memofs;
-          memofs+=ip;
-          for (size_t j=0; j<ip; ++j)
-            fact[k].tws[j] = twiddle[j*l1*ido];
+          fact[k].tws=twd+memofs;
+          memofs+=fact[k].rader ? ip-1 : ip;
           }
         l1*=ip;
         }
       }
 
-  public:
-    POCKETFFT_NOINLINE cfftp(size_t length_)
-      : length(length_)
+    void comp_twiddle()
+      {
+      assign_twiddle();
+      sincos_2pibyn<T0> twiddle(length);
+      size_t l1=1;
+      for (size_t k=0; k<fact.size(); ++k)
+        {
+        size_t ip=fact[k].fct, ido=length/(l1*ip);
+        for (size_t j=1; j<ip; ++j)
+          for (size_t i=1; i<ido; ++i)
+            fact[k].tw[(j-1)*(ido-1)+i-1] = twiddle[j*l1*i];
+        if (fact[k].rader)
+          comp_rader_kernel(fact[k]);
+        else if ((ip>11) && (ip&1))
+          for (size_t j=0; j<ip; ++j)
+            fact[k].tws[j] = twiddle[j*l1*ido];
+        l1*=ip;
+        }
+      }
+
+  public:
+    /* Prime factors above 11 are computed with Rader's algorithm where the
+       cost model prefers it, and with the generic pass otherwise. */
+    POCKETFFT_NOINLINE cfftp(size_t length_)
+      : length(length_), twd(nullptr)
       {
       if (length==0) throw std::runtime_error("zero-length FFT requested");
       if (length==1) return;
-      factorize();
+      for (auto f: factorize(length))
+        add_factor(f, util::rader_preferred(f, length));
+      init_rader();
+      mem.resize(twsize());
+      twd = mem.data();
+      comp_twiddle();
+      }
+    /* uses the given factors (in this order) instead of the default ones;
+       if `rader` is true, all prime factors above 11 are computed with
+       Rader's algorithm, otherwise with the generic pass */
+    POCKETFFT_NOINLINE cfftp(size_t length_, const std::vector<size_t> &factors,
+      bool rader=false)
+      : length(length_), twd(nullptr)
+      {
+      if (length==0) throw std::runtime_error("zero-length FFT requested");
+      for (auto f: factors)
+        add_factor(f, rader && util::rader_possible(f));
+      if (!factors_valid()) throw std::invalid_argument("bad factorization");
+      init_rader();
       mem.resize(twsize());
+      twd = mem.data();
       comp_twiddle();
       }
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE cfftp(plan_reader &rd)
+      : length(rd.get_size()), twd(nullptr)
+      {
+      if (length==0) throw std::runtime_error("corrupt plan data");
+      size_t nfct=rd.get_size();
+      if (nfct>64) throw std::runtime_error("corrupt plan data");
+      for (size_t k=0; k<nfct; ++k)
+        {
+        size_t ip=rd.get_size();
+        auto rader=rd.get<std::uint8_t>();
+        if (rader>1) throw std::runtime_error("corrupt plan data");
+        add_factor(ip, rader!=0);
+        }
+      if (!factors_valid()) throw std::runtime_error("corrupt plan data");
+      twd = rd.get_array<cmplx<T0>>(twsize());
+      ext = rd.keepalive();
+      assign_twiddle();
+      for (auto &f: fact)
+        if (f.rader)
+          {
+          comp_rader_perm(f);
+          f.rplan=std::unique_ptr<cfftp>(new cfftp(rd));
+          if (f.rplan->len()!=f.fct-1)
+            throw std::runtime_error("corrupt plan data");
+          }
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(length);
+      wr.put_size(fact.size());
+      for (const auto &f: fact)
+        {
+        wr.put_size(f.fct);
+        wr.put(std::uint8_t(f.rader ? 1 : 0));
+        }
+      wr.put_array(twd, twsize());
+      for (const auto &f: fact)
+        if (f.rader)
+          f.rplan->serialize(wr);
+      }
+
+    size_t len() const { return length; }
+
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      {
+      size_t res = mem.size()*sizeof(cmplx<T0>) + fact.size()*sizeof(fctdata);
+      for (const auto &f: fact)
+        if (f.rader)
+          res += f.perm.size()*sizeof(size_t) + sizeof(cfftp)
+               + f.rplan->memory_size();
+      return res;
+      }
   };
 
 //
@@ -1545,6 +2309,8 @@ template<typename T0> class rfftp
 
     size_t length;
     arr<T0> mem;
+    T0 *twd; // start of the twiddle factors
+    std::shared_ptr<const void> ext; // owner of twd, if not stored in mem
     std::vector<fctdata> fact;
 
     void add_factor(size_t factor)
@@ -1555,13 +2321,13 @@ template<typename T1, typename T2, typename T3> inline void MULPM
   (T1 &a, T1 &b, T2 c, T2 d, T3 e, T3 f) const
   {  a=c*e+d*f; b=c*f-d*e; }
 
-template<typename T> void radf2 (size_t ido, size_t l1,
+template<bool scale, typename T> void radf2 (size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido,l1](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
   auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+2*c)]; };
 
@@ -1592,15 +2358,15 @@ template<typename T> void radf2 (size_t ido, size_t l1,
   rx=t1; ix=t3; ry=t4; iy=t2; \
   }
 
-template<typename T> void radf3(size_t ido, size_t l1,
+template<bool scale, typename T> void radf3(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 taur=-0.5, taui=T0(0.8660254037844386467637231707529362L);
 
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido,l1](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
   auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+3*c)]; };
 
@@ -1631,15 +2397,15 @@ template<typename T> void radf3(size_t ido, size_t l1,
       }
   }
 
-template<typename T> void radf4(size_t ido, size_t l1,
+template<bool scale, typename T> void radf4(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 hsqt2=T0(0.707106781186547524400844362104849L);
 
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido,l1](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
   auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+4*c)]; };
 
@@ -1678,9 +2444,9 @@ template<typename T> void radf4(size_t ido, size_t l1,
       }
   }
 
-template<typename T> void radf5(size_t ido, size_t l1,
+template<bool scale, typename T> void radf5(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 tr11= T0(0.3090169943749474241022934171828191L),
                ti11= T0(0.9510565162951535721164393333793821L),
@@ -1688,8 +2454,8 @@ template<typename T> void radf5(size_t ido, size_t l1,
                ti12= T0(0.5877852522924731291687059546390728L);
 
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido,l1](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
   auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+5*c)]; };
 
@@ -1732,6 +2498,256 @@ template<typename T> void radf5(size_t ido, size_t l1,
       }
   }
 
+#define POCKETFFT_RADF7STEP0(m,u1,u2,u3,v1,v2,v3) \
+      CH(ido-1,2*m-1,k)=CC(0,k,0)+u1*cr1+u2*cr2+u3*cr3; \
+      CH(0,2*m,k)=v1*ci1+v2*ci2+v3*ci3;
+
+#define POCKETFFT_RADF7STEP(m,u1,u2,u3,v1,v2,v3) \
+      { \
+      T ar=CC(i-1,k,0)+u1*dr1+u2*dr2+u3*dr3, \
+        ai=CC(i  ,k,0)+u1*di1+u2*di2+u3*di3, \
+        br=v1*dr6+v2*dr5+v3*dr4, \
+        bi=v1*di6+v2*di5+v3*di4; \
+      PM(CH(i-1,2*m,k),CH(ic-1,2*m-1,k),ar,br); \
+      PM(CH(i  ,2*m,k),CH(ic  ,2*m-1,k),bi,ai); \
+      }
+
+template<bool scale, typename T> void radf7(size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 tw1r= T0(0.6234898018587335305250048840042398L),
+               tw1i= T0(0.7818314824680298087084445266740578L),
+               tw2r= T0(-0.2225209339563144042889025644967948L),
+               tw2i= T0(0.9749279121818236070181316829939312L),
+               tw3r= T0(-0.9009688679024191262361023195074451L),
+               tw3i= T0(0.433883739117558120475768332848359L);
+
+  auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
+  auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+7*c)]; };
+
+  for (size_t k=0; k<l1; k++)
+    {
+    T cr1, cr2, cr3, ci1, ci2, ci3;
+    PM (cr1,ci1,CC(0,k,6),CC(0,k,1));
+    PM (cr2,ci2,CC(0,k,5),CC(0,k,2));
+    PM (cr3,ci3,CC(0,k,4),CC(0,k,3));
+    CH(0,0,k)=CC(0,k,0)+cr1+cr2+cr3;
+    POCKETFFT_RADF7STEP0(1,tw1r,tw2r,tw3r,tw1i,tw2i,tw3i)
+    POCKETFFT_RADF7STEP0(2,tw2r,tw3r,tw1r,tw2i,-tw3i,-tw1i)
+    POCKETFFT_RADF7STEP0(3,tw3r,tw1r,tw2r,tw3i,-tw1i,tw2i)
+    }
+  if (ido==1) return;
+  for (size_t k=0; k<l1;++k)
+    for (size_t i=2, ic=ido-2; i<ido; i+=2, ic-=2)
+      {
+      T di1, di2, di3, di4, di5, di6, dr1, dr2, dr3, dr4, dr5, dr6;
+      MULPM (dr1,di1,WA(0,i-2),WA(0,i-1),CC(i-1,k,1),CC(i,k,1));
+      MULPM (dr2,di2,WA(1,i-2),WA(1,i-1),CC(i-1,k,2),CC(i,k,2));
+      MULPM (dr3,di3,WA(2,i-2),WA(2,i-1),CC(i-1,k,3),CC(i,k,3));
+      MULPM (dr4,di4,WA(3,i-2),WA(3,i-1),CC(i-1,k,4),CC(i,k,4));
+      MULPM (dr5,di5,WA(4,i-2),WA(4,i-1),CC(i-1,k,5),CC(i,k,5));
+      MULPM (dr6,di6,WA(5,i-2),WA(5,i-1),CC(i-1,k,6),CC(i,k,6));
+      POCKETFFT_REARRANGE(dr1, di1, dr6, di6);
+      POCKETFFT_REARRANGE(dr2, di2, dr5, di5);
+      POCKETFFT_REARRANGE(dr3, di3, dr4, di4);
+      CH(i-1,0,k)=CC(i-1,k,0)+dr1+dr2+dr3;
+      CH(i  ,0,k)=CC(i  ,k,0)+di1+di2+di3;
+      POCKETFFT_RADF7STEP(1,tw1r,tw2r,tw3r,tw1i,tw2i,tw3i)
+      POCKETFFT_RADF7STEP(2,tw2r,tw3r,tw1r,tw2i,-tw3i,-tw1i)
+      POCKETFFT_RADF7STEP(3,tw3r,tw1r,tw2r,tw3i,-tw1i,tw2i)
+      }
+  }
+
+#undef POCKETFFT_RADF7STEP
+#undef POCKETFFT_RADF7STEP0
+
+template<bool scale, typename T> void radf8(size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 hsqt2=T0(0.707106781186547524400844362104849L),
+               c16=T0(0.923879532511286756128183189396788L),
+               s16=T0(0.382683432365089771728459984030399L);
+
+  auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
+  auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+8*c)]; };
+
+  for (size_t k=0; k<l1; k++)
+    {
+    T t0, t1, t2, t3, t4, t5, t6, t7;
+    PM (t0,t1,CC(0,k,0),CC(0,k,4));
+    PM (t2,t3,CC(0,k,2),CC(0,k,6));
+    PM (t4,t5,CC(0,k,1),CC(0,k,5));
+    PM (t6,t7,CC(0,k,3),CC(0,k,7));
+    PMINPLACE(t0,t2);
+    PMINPLACE(t4,t6);
+    PM (CH(0,0,k),CH(ido-1,7,k),t0,t4);
+    CH(ido-1,3,k)=t2;
+    CH(0,4,k)=-t6;
+    T tr=hsqt2*(t5-t7), ti=-hsqt2*(t5+t7);
+    PM (CH(ido-1,1,k),CH(ido-1,5,k),t1,tr);
+    PM (CH(0,6,k),CH(0,2,k),ti,t3);
+    }
+  if ((ido&1)==0)
+    for (size_t k=0; k<l1; k++)
+      {
+      /* half-sample shifted 4-point DFTs of the even and odd inputs */
+      T tr1= hsqt2*(CC(ido-1,k,2)-CC(ido-1,k,6)),
+        ti1=-hsqt2*(CC(ido-1,k,2)+CC(ido-1,k,6)),
+        tr2= hsqt2*(CC(ido-1,k,3)-CC(ido-1,k,7)),
+        ti2=-hsqt2*(CC(ido-1,k,3)+CC(ido-1,k,7));
+      T p0r, p1r, p0i, p1i, q0r, q1r, q0i, q1i;
+      PM (p0r,p1r,CC(ido-1,k,0),tr1);
+      PM (p1i,p0i,ti1,CC(ido-1,k,4));
+      PM (q0r,q1r,CC(ido-1,k,1),tr2);
+      PM (q1i,q0i,ti2,CC(ido-1,k,5));
+      /* multiply the odd part by exp(-i*pi/8) and exp(-3i*pi/8) */
+      T r0r=c16*q0r+s16*q0i, r0i=c16*q0i-s16*q0r,
+        r1r=s16*q1r+c16*q1i, r1i=s16*q1i-c16*q1r;
+      PM (CH(ido-1,0,k),CH(ido-1,6,k),p0r,r0r);
+      PM (CH(0,1,k),CH(0,7,k),r0i,p0i);
+      PM (CH(ido-1,2,k),CH(ido-1,4,k),p1r,r1r);
+      PM (CH(0,3,k),CH(0,5,k),r1i,p1i);
+      }
+  if (ido<=2) return;
+  for (size_t k=0; k<l1; k++)
+    for (size_t i=2; i<ido; i+=2)
+      {
+      size_t ic=ido-i;
+      cmplx<T> a0{CC(i-1,k,0),CC(i,k,0)}, a1, a2, a3, a4, a5, a6, a7;
+      MULPM(a1.r,a1.i,WA(0,i-2),WA(0,i-1),CC(i-1,k,1),CC(i,k,1));
+      MULPM(a2.r,a2.i,WA(1,i-2),WA(1,i-1),CC(i-1,k,2),CC(i,k,2));
+      MULPM(a3.r,a3.i,WA(2,i-2),WA(2,i-1),CC(i-1,k,3),CC(i,k,3));
+      MULPM(a4.r,a4.i,WA(3,i-2),WA(3,i-1),CC(i-1,k,4),CC(i,k,4));
+      MULPM(a5.r,a5.i,WA(4,i-2),WA(4,i-1),CC(i-1,k,5),CC(i,k,5));
+      MULPM(a6.r,a6.i,WA(5,i-2),WA(5,i-1),CC(i-1,k,6),CC(i,k,6));
+      MULPM(a7.r,a7.i,WA(6,i-2),WA(6,i-1),CC(i-1,k,7),CC(i,k,7));
+      /* 4-point DFTs of the even and odd inputs */
+      PMINPLACE(a0,a4);
+      PMINPLACE(a2,a6);
+      ROTX90<true>(a6);
+      PMINPLACE(a0,a2);
+      PMINPLACE(a4,a6);
+      PMINPLACE(a1,a5);
+      PMINPLACE(a3,a7);
+      ROTX90<true>(a7);
+      PMINPLACE(a1,a3);
+      PMINPLACE(a5,a7);
+      ROTX90<true>(a3);
+      a5 = cmplx<T>(hsqt2*(a5.r+a5.i), hsqt2*(a5.i-a5.r));
+      a7 = cmplx<T>(hsqt2*(a7.i-a7.r), -hsqt2*(a7.r+a7.i));
+      PM(CH(i-1,0,k),CH(ic-1,7,k),a0.r,a1.r);
+      PM(CH(i  ,0,k),CH(ic  ,7,k),a1.i,a0.i);
+      PM(CH(i-1,2,k),CH(ic-1,5,k),a4.r,a5.r);
+      PM(CH(i  ,2,k),CH(ic  ,5,k),a5.i,a4.i);
+      PM(CH(i-1,4,k),CH(ic-1,3,k),a2.r,a3.r);
+      PM(CH(i  ,4,k),CH(ic  ,3,k),a3.i,a2.i);
+      PM(CH(i-1,6,k),CH(ic-1,1,k),a6.r,a7.r);
+      PM(CH(i  ,6,k),CH(ic  ,1,k),a7.i,a6.i);
+      }
+  }
+
+#define POCKETFFT_RADF11STEP0(m,u1,u2,u3,u4,u5,v1,v2,v3,v4,v5) \
+      CH(ido-1,2*m-1,k)=CC(0,k,0)+u1*cr1+u2*cr2+u3*cr3+u4*cr4+u5*cr5; \
+      CH(0,2*m,k)=v1*ci1+v2*ci2+v3*ci3+v4*ci4+v5*ci5;
+
+#define POCKETFFT_RADF11STEP(m,u1,u2,u3,u4,u5,v1,v2,v3,v4,v5) \
+      { \
+      T ar=CC(i-1,k,0)+u1*dr1+u2*dr2+u3*dr3+u4*dr4+u5*dr5, \
+        ai=CC(i  ,k,0)+u1*di1+u2*di2+u3*di3+u4*di4+u5*di5, \
+        br=v1*dr10+v2*dr9+v3*dr8+v4*dr7+v5*dr6, \
+        bi=v1*di10+v2*di9+v3*di8+v4*di7+v5*di6; \
+      PM(CH(i-1,2*m,k),CH(ic-1,2*m-1,k),ar,br); \
+      PM(CH(i  ,2*m,k),CH(ic  ,2*m-1,k),bi,ai); \
+      }
+
+template<bool scale, typename T> void radf11(size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 tw1r= T0(0.8412535328311811688618116489193677L),
+               tw1i= T0(0.5406408174555975821076359543186917L),
+               tw2r= T0(0.4154150130018864255292741492296232L),
+               tw2i= T0(0.9096319953545183714117153830790285L),
+               tw3r= T0(-0.1423148382732851404437926686163697L),
+               tw3i= T0(0.9898214418809327323760920377767188L),
+               tw4r= T0(-0.6548607339452850640569250724662936L),
+               tw4i= T0(0.7557495743542582837740358439723444L),
+               tw5r= T0(-0.9594929736144973898903680570663277L),
+               tw5i= T0(0.2817325568414296977114179153466169L);
+
+  auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
+  auto CC = [cc,ido,l1,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+l1*c)], fct); };
+  auto CH = [ch,ido](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+11*c)]; };
+
+  for (size_t k=0; k<l1; k++)
+    {
+    T cr1, cr2, cr3, cr4, cr5, ci1, ci2, ci3, ci4, ci5;
+    PM (cr1,ci1,CC(0,k,10),CC(0,k,1));
+    PM (cr2,ci2,CC(0,k, 9),CC(0,k,2));
+    PM (cr3,ci3,CC(0,k, 8),CC(0,k,3));
+    PM (cr4,ci4,CC(0,k, 7),CC(0,k,4));
+    PM (cr5,ci5,CC(0,k, 6),CC(0,k,5));
+    CH(0,0,k)=CC(0,k,0)+cr1+cr2+cr3+cr4+cr5;
+    POCKETFFT_RADF11STEP0(1,tw1r,tw2r,tw3r,tw4r,tw5r,
+                            tw1i,tw2i,tw3i,tw4i,tw5i)
+    POCKETFFT_RADF11STEP0(2,tw2r,tw4r,tw5r,tw3r,tw1r,
+                            tw2i,tw4i,-tw5i,-tw3i,-tw1i)
+    POCKETFFT_RADF11STEP0(3,tw3r,tw5r,tw2r,tw1r,tw4r,
+                            tw3i,-tw5i,-tw2i,tw1i,tw4i)
+    POCKETFFT_RADF11STEP0(4,tw4r,tw3r,tw1r,tw5r,tw2r,
+                            tw4i,-tw3i,tw1i,tw5i,-tw2i)
+    POCKETFFT_RADF11STEP0(5,tw5r,tw1r,tw4r,tw2r,tw3r,
+                            tw5i,-tw1i,tw4i,-tw2i,tw3i)
+    }
+  if (ido==1) return;
+  for (size_t k=0; k<l1;++k)
+    for (size_t i=2, ic=ido-2; i<ido; i+=2, ic-=2)
+      {
+      T di1, di2, di3, di4, di5, di6, di7, di8, di9, di10,
+        dr1, dr2, dr3, dr4, dr5, dr6, dr7, dr8, dr9, dr10;
+      MULPM (dr1 ,di1 ,WA(0,i-2),WA(0,i-1),CC(i-1,k, 1),CC(i,k, 1));
+      MULPM (dr2 ,di2 ,WA(1,i-2),WA(1,i-1),CC(i-1,k, 2),CC(i,k, 2));
+      MULPM (dr3 ,di3 ,WA(2,i-2),WA(2,i-1),CC(i-1,k, 3),CC(i,k, 3));
+      MULPM (dr4 ,di4 ,WA(3,i-2),WA(3,i-1),CC(i-1,k, 4),CC(i,k, 4));
+      MULPM (dr5 ,di5 ,WA(4,i-2),WA(4,i-1),CC(i-1,k, 5),CC(i,k, 5));
+      MULPM (dr6 ,di6 ,WA(5,i-2),WA(5,i-1),CC(i-1,k, 6),CC(i,k, 6));
+      MULPM (dr7 ,di7 ,WA(6,i-2),WA(6,i-1),CC(i-1,k, 7),CC(i,k, 7));
+      MULPM (dr8 ,di8 ,WA(7,i-2),WA(7,i-1),CC(i-1,k, 8),CC(i,k, 8));
+      MULPM (dr9 ,di9 ,WA(8,i-2),WA(8,i-1),CC(i-1,k, 9),CC(i,k, 9));
+      MULPM (dr10,di10,WA(9,i-2),WA(9,i-1),CC(i-1,k,10),CC(i,k,10));
+      POCKETFFT_REARRANGE(dr1, di1, dr10, di10);
+      POCKETFFT_REARRANGE(dr2, di2, dr9, di9);
+      POCKETFFT_REARRANGE(dr3, di3, dr8, di8);
+      POCKETFFT_REARRANGE(dr4, di4, dr7, di7);
+      POCKETFFT_REARRANGE(dr5, di5, dr6, di6);
+      CH(i-1,0,k)=CC(i-1,k,0)+dr1+dr2+dr3+dr4+dr5;
+      CH(i  ,0,k)=CC(i  ,k,0)+di1+di2+di3+di4+di5;
+      POCKETFFT_RADF11STEP(1,tw1r,tw2r,tw3r,tw4r,tw5r,
+                             tw1i,tw2i,tw3i,tw4i,tw5i)
+      POCKETFFT_RADF11STEP(2,tw2r,tw4r,tw5r,tw3r,tw1r,
+                             tw2i,tw4i,-tw5i,-tw3i,-tw1i)
+      POCKETFFT_RADF11STEP(3,tw3r,tw5r,tw2r,tw1r,tw4r,
+                             tw3i,-tw5i,-tw2i,tw1i,tw4i)
+      POCKETFFT_RADF11STEP(4,tw4r,tw3r,tw1r,tw5r,tw2r,
+                             tw4i,-tw3i,tw1i,tw5i,-tw2i)
+      POCKETFFT_RADF11STEP(5,tw5r,tw1r,tw4r,tw2r,tw3r,
+                             tw5i,-tw1i,tw4i,-tw2i,tw3i)
+      }
+  }
+
+#undef POCKETFFT_RADF11STEP
+#undef POCKETFFT_RADF11STEP0
+
 #undef POCKETFFT_REARRANGE
 
 template<typename T> void radfg(size_t ido, size_t ip, size_t l1,
@@ -1876,13 +2892,13 @@ template<typename T> void radfg(size_t ido, size_t ip, size_t l1,
     }
   }
 
-template<typename T> void radb2(size_t ido, size_t l1,
+template<bool scale, typename T> void radb2(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+2*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+2*c)], fct); };
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
 
@@ -1906,15 +2922,15 @@ template<typename T> void radb2(size_t ido, size_t l1,
       }
   }
 
-template<typename T> void radb3(size_t ido, size_t l1,
+template<bool scale, typename T> void radb3(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 taur=-0.5, taui=T0(0.8660254037844386467637231707529362L);
 
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+3*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+3*c)], fct); };
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
 
@@ -1946,15 +2962,15 @@ template<typename T> void radb3(size_t ido, size_t l1,
       }
   }
 
-template<typename T> void radb4(size_t ido, size_t l1,
+template<bool scale, typename T> void radb4(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
 
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+4*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+4*c)], fct); };
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
 
@@ -1998,9 +3014,9 @@ template<typename T> void radb4(size_t ido, size_t l1,
       }
   }
 
-template<typename T> void radb5(size_t ido, size_t l1,
+template<bool scale, typename T> void radb5(size_t ido, size_t l1,
   const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
-  const T0 * POCKETFFT_RESTRICT wa) const
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
   {
   constexpr T0 tr11= T0(0.3090169943749474241022934171828191L),
                ti11= T0(0.9510565162951535721164393333793821L),
@@ -2008,8 +3024,8 @@ template<typename T> void radb5(size_t ido, size_t l1,
                ti12= T0(0.5877852522924731291687059546390728L);
 
   auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
-  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
-    { return cc[a+ido*(b+5*c)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+5*c)], fct); };
   auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
     { return ch[a+ido*(b+l1*c)]; };
 
@@ -2057,6 +3073,251 @@ template<typename T> void radb5(size_t ido, size_t l1,
       }
   }
 
+#define POCKETFFT_RADB7STEP0(j,jc,u1,u2,u3,v1,v2,v3) \
+      PM(CH(0,k,jc),CH(0,k,j),CC(0,0,k)+u1*tr1+u2*tr2+u3*tr3, \
+         v1*ti1+v2*ti2+v3*ti3);
+
+#define POCKETFFT_RADB7STEP(j,jc,u1,u2,u3,v1,v2,v3) \
+      { \
+      T cr=CC(i-1,0,k)+u1*tr1+u2*tr2+u3*tr3, \
+        ci=CC(i  ,0,k)+u1*ti1+u2*ti2+u3*ti3, \
+        sr=v1*tr6+v2*tr5+v3*tr4, \
+        si=v1*ti6+v2*ti5+v3*ti4; \
+      T dr1, dr2, di1, di2; \
+      PM(dr2,dr1,cr,si); \
+      PM(di1,di2,ci,sr); \
+      MULPM(CH(i,k,j ),CH(i-1,k,j ),WA(j -1,i-2),WA(j -1,i-1),di1,dr1); \
+      MULPM(CH(i,k,jc),CH(i-1,k,jc),WA(jc-1,i-2),WA(jc-1,i-1),di2,dr2); \
+      }
+
+template<bool scale, typename T> void radb7(size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 tw1r= T0(0.6234898018587335305250048840042398L),
+               tw1i= T0(0.7818314824680298087084445266740578L),
+               tw2r= T0(-0.2225209339563144042889025644967948L),
+               tw2i= T0(0.9749279121818236070181316829939312L),
+               tw3r= T0(-0.9009688679024191262361023195074451L),
+               tw3i= T0(0.433883739117558120475768332848359L);
+
+  auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+7*c)], fct); };
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+
+  for (size_t k=0; k<l1; k++)
+    {
+    T tr1=2*CC(ido-1,1,k), tr2=2*CC(ido-1,3,k), tr3=2*CC(ido-1,5,k),
+      ti1=2*CC(0,2,k), ti2=2*CC(0,4,k), ti3=2*CC(0,6,k);
+    CH(0,k,0)=CC(0,0,k)+tr1+tr2+tr3;
+    POCKETFFT_RADB7STEP0(1,6,tw1r,tw2r,tw3r,tw1i,tw2i,tw3i)
+    POCKETFFT_RADB7STEP0(2,5,tw2r,tw3r,tw1r,tw2i,-tw3i,-tw1i)
+    POCKETFFT_RADB7STEP0(3,4,tw3r,tw1r,tw2r,tw3i,-tw1i,tw2i)
+    }
+  if (ido==1) return;
+  for (size_t k=0; k<l1;++k)
+    for (size_t i=2, ic=ido-2; i<ido; i+=2, ic-=2)
+      {
+      T tr1, tr2, tr3, tr4, tr5, tr6, ti1, ti2, ti3, ti4, ti5, ti6;
+      PM(tr1,tr6,CC(i-1,2,k),CC(ic-1,1,k));
+      PM(ti6,ti1,CC(i  ,2,k),CC(ic  ,1,k));
+      PM(tr2,tr5,CC(i-1,4,k),CC(ic-1,3,k));
+      PM(ti5,ti2,CC(i  ,4,k),CC(ic  ,3,k));
+      PM(tr3,tr4,CC(i-1,6,k),CC(ic-1,5,k));
+      PM(ti4,ti3,CC(i  ,6,k),CC(ic  ,5,k));
+      CH(i-1,k,0)=CC(i-1,0,k)+tr1+tr2+tr3;
+      CH(i  ,k,0)=CC(i  ,0,k)+ti1+ti2+ti3;
+      POCKETFFT_RADB7STEP(1,6,tw1r,tw2r,tw3r,tw1i,tw2i,tw3i)
+      POCKETFFT_RADB7STEP(2,5,tw2r,tw3r,tw1r,tw2i,-tw3i,-tw1i)
+      POCKETFFT_RADB7STEP(3,4,tw3r,tw1r,tw2r,tw3i,-tw1i,tw2i)
+      }
+  }
+
+#undef POCKETFFT_RADB7STEP
+#undef POCKETFFT_RADB7STEP0
+
+template<bool scale, typename T> void radb8(size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L),
+               hsqt2=T0(0.707106781186547524400844362104849L),
+               c16=T0(0.923879532511286756128183189396788L),
+               s16=T0(0.382683432365089771728459984030399L);
+
+  auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+8*c)], fct); };
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+
+  for (size_t k=0; k<l1; k++)
+    {
+    T s0, s1, a0, a1, a2, a3, tr1, tr2, ti1, ti2;
+    PM (s0,s1,CC(0,0,k),CC(ido-1,7,k));
+    PM (a0,a2,s0,2*CC(ido-1,3,k));
+    PM (a3,a1,s1,2*CC(0,4,k));
+    PM (tr1,tr2,CC(ido-1,1,k),CC(ido-1,5,k));
+    PM (ti1,ti2,CC(0,2,k),CC(0,6,k));
+    PM (CH(0,k,0),CH(0,k,4),a0,tr1+tr1);
+    PM (CH(0,k,6),CH(0,k,2),a2,ti2+ti2);
+    PM (CH(0,k,1),CH(0,k,5),a1,sqrt2*(tr2-ti1));
+    PM (CH(0,k,7),CH(0,k,3),a3,sqrt2*(tr2+ti1));
+    }
+  if ((ido&1)==0)
+    for (size_t k=0; k<l1; k++)
+      {
+      /* split into the even and odd outputs, then undo the half-sample
+         shifted 4-point DFTs as in radb4 */
+      T u0r, u0i, u1r, u1i, v0r, v0i, v1r, v1i;
+      PM (u0r,v0r,CC(ido-1,0,k),CC(ido-1,6,k));
+      PM (v0i,u0i,CC(0,1,k),CC(0,7,k));
+      PM (u1r,v1r,CC(ido-1,2,k),CC(ido-1,4,k));
+      PM (v1i,u1i,CC(0,3,k),CC(0,5,k));
+      /* multiply the odd part by exp(i*pi/8) and exp(3i*pi/8) */
+      T w0r=c16*v0r-s16*v0i, w0i=c16*v0i+s16*v0r,
+        w1r=s16*v1r-c16*v1i, w1i=s16*v1i+c16*v1r;
+      T tr1, tr2, ti1, ti2;
+      PM (tr2,tr1,u0r,u1r);
+      PM (ti1,ti2,u1i,u0i);
+      CH(ido-1,k,0)=tr2+tr2;
+      CH(ido-1,k,2)=sqrt2*(tr1-ti1);
+      CH(ido-1,k,4)=ti2+ti2;
+      CH(ido-1,k,6)=-sqrt2*(tr1+ti1);
+      PM (tr2,tr1,w0r,w1r);
+      PM (ti1,ti2,w1i,w0i);
+      CH(ido-1,k,1)=tr2+tr2;
+      CH(ido-1,k,3)=sqrt2*(tr1-ti1);
+      CH(ido-1,k,5)=ti2+ti2;
+      CH(ido-1,k,7)=-sqrt2*(tr1+ti1);
+      }
+  if (ido<=2) return;
+  for (size_t k=0; k<l1;++k)
+    for (size_t i=2; i<ido; i+=2)
+      {
+      size_t ic=ido-i;
+      cmplx<T> a0{CC(i-1,0,k), CC(i,0,k)}, a1{CC(i-1,2,k), CC(i,2,k)},
+               a2{CC(i-1,4,k), CC(i,4,k)}, a3{CC(i-1,6,k), CC(i,6,k)},
+               a4{CC(ic-1,7,k),-CC(ic,7,k)}, a5{CC(ic-1,5,k),-CC(ic,5,k)},
+               a6{CC(ic-1,3,k),-CC(ic,3,k)}, a7{CC(ic-1,1,k),-CC(ic,1,k)};
+      /* 4-point DFTs of the even and odd inputs */
+      PMINPLACE(a0,a4);
+      PMINPLACE(a2,a6);
+      ROTX90<false>(a6);
+      PMINPLACE(a0,a2);
+      PMINPLACE(a4,a6);
+      PMINPLACE(a1,a5);
+      PMINPLACE(a3,a7);
+      ROTX90<false>(a7);
+      PMINPLACE(a1,a3);
+      PMINPLACE(a5,a7);
+      ROTX90<false>(a3);
+      a5 = cmplx<T>(hsqt2*(a5.r-a5.i), hsqt2*(a5.i+a5.r));
+      a7 = cmplx<T>(-hsqt2*(a7.r+a7.i), hsqt2*(a7.r-a7.i));
+      CH(i-1,k,0) = a0.r+a1.r;
+      CH(i  ,k,0) = a0.i+a1.i;
+      MULPM (CH(i,k,4),CH(i-1,k,4),WA(3,i-2),WA(3,i-1),a0.i-a1.i,a0.r-a1.r);
+      MULPM (CH(i,k,1),CH(i-1,k,1),WA(0,i-2),WA(0,i-1),a4.i+a5.i,a4.r+a5.r);
+      MULPM (CH(i,k,5),CH(i-1,k,5),WA(4,i-2),WA(4,i-1),a4.i-a5.i,a4.r-a5.r);
+      MULPM (CH(i,k,2),CH(i-1,k,2),WA(1,i-2),WA(1,i-1),a2.i+a3.i,a2.r+a3.r);
+      MULPM (CH(i,k,6),CH(i-1,k,6),WA(5,i-2),WA(5,i-1),a2.i-a3.i,a2.r-a3.r);
+      MULPM (CH(i,k,3),CH(i-1,k,3),WA(2,i-2),WA(2,i-1),a6.i+a7.i,a6.r+a7.r);
+      MULPM (CH(i,k,7),CH(i-1,k,7),WA(6,i-2),WA(6,i-1),a6.i-a7.i,a6.r-a7.r);
+      }
+  }
+
+#define POCKETFFT_RADB11STEP0(j,jc,u1,u2,u3,u4,u5,v1,v2,v3,v4,v5) \
+      PM(CH(0,k,jc),CH(0,k,j),CC(0,0,k)+u1*tr1+u2*tr2+u3*tr3+u4*tr4+u5*tr5, \
+         v1*ti1+v2*ti2+v3*ti3+v4*ti4+v5*ti5);
+
+#define POCKETFFT_RADB11STEP(j,jc,u1,u2,u3,u4,u5,v1,v2,v3,v4,v5) \
+      { \
+      T cr=CC(i-1,0,k)+u1*tr1+u2*tr2+u3*tr3+u4*tr4+u5*tr5, \
+        ci=CC(i  ,0,k)+u1*ti1+u2*ti2+u3*ti3+u4*ti4+u5*ti5, \
+        sr=v1*tr10+v2*tr9+v3*tr8+v4*tr7+v5*tr6, \
+        si=v1*ti10+v2*ti9+v3*ti8+v4*ti7+v5*ti6; \
+      T dr1, dr2, di1, di2; \
+      PM(dr2,dr1,cr,si); \
+      PM(di1,di2,ci,sr); \
+      MULPM(CH(i,k,j ),CH(i-1,k,j ),WA(j -1,i-2),WA(j -1,i-1),di1,dr1); \
+      MULPM(CH(i,k,jc),CH(i-1,k,jc),WA(jc-1,i-2),WA(jc-1,i-1),di2,dr2); \
+      }
+
+template<bool scale, typename T> void radb11(size_t ido, size_t l1,
+  const T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
+  const T0 * POCKETFFT_RESTRICT wa, T0 fct) const
+  {
+  constexpr T0 tw1r= T0(0.8412535328311811688618116489193677L),
+               tw1i= T0(0.5406408174555975821076359543186917L),
+               tw2r= T0(0.4154150130018864255292741492296232L),
+               tw2i= T0(0.9096319953545183714117153830790285L),
+               tw3r= T0(-0.1423148382732851404437926686163697L),
+               tw3i= T0(0.9898214418809327323760920377767188L),
+               tw4r= T0(-0.6548607339452850640569250724662936L),
+               tw4i= T0(0.7557495743542582837740358439723444L),
+               tw5r= T0(-0.9594929736144973898903680570663277L),
+               tw5i= T0(0.2817325568414296977114179153466169L);
+
+  auto WA = [wa,ido](size_t x, size_t i) { return wa[i+x*(ido-1)]; };
+  auto CC = [cc,ido,fct](size_t a, size_t b, size_t c) -> T
+    { return scale_if<scale>(cc[a+ido*(b+11*c)], fct); };
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+
+  for (size_t k=0; k<l1; k++)
+    {
+    T tr1=2*CC(ido-1,1,k), tr2=2*CC(ido-1,3,k), tr3=2*CC(ido-1,5,k),
+      tr4=2*CC(ido-1,7,k), tr5=2*CC(ido-1,9,k),
+      ti1=2*CC(0,2,k), ti2=2*CC(0,4,k), ti3=2*CC(0,6,k),
+      ti4=2*CC(0,8,k), ti5=2*CC(0,10,k);
+    CH(0,k,0)=CC(0,0,k)+tr1+tr2+tr3+tr4+tr5;
+    POCKETFFT_RADB11STEP0(1,10,tw1r,tw2r,tw3r,tw4r,tw5r,
+                               tw1i,tw2i,tw3i,tw4i,tw5i)
+    POCKETFFT_RADB11STEP0(2,9,tw2r,tw4r,tw5r,tw3r,tw1r,
+                              tw2i,tw4i,-tw5i,-tw3i,-tw1i)
+    POCKETFFT_RADB11STEP0(3,8,tw3r,tw5r,tw2r,tw1r,tw4r,
+                              tw3i,-tw5i,-tw2i,tw1i,tw4i)
+    POCKETFFT_RADB11STEP0(4,7,tw4r,tw3r,tw1r,tw5r,tw2r,
+                              tw4i,-tw3i,tw1i,tw5i,-tw2i)
+    POCKETFFT_RADB11STEP0(5,6,tw5r,tw1r,tw4r,tw2r,tw3r,
+                              tw5i,-tw1i,tw4i,-tw2i,tw3i)
+    }
+  if (ido==1) return;
+  for (size_t k=0; k<l1;++k)
+    for (size_t i=2, ic=ido-2; i<ido; i+=2, ic-=2)
+      {
+      T tr1, tr2, tr3, tr4, tr5, tr6, tr7, tr8, tr9, tr10,
+        ti1, ti2, ti3, ti4, ti5, ti6, ti7, ti8, ti9, ti10;
+      PM(tr1,tr10,CC(i-1, 2,k),CC(ic-1,1,k));
+      PM(ti10,ti1,CC(i  , 2,k),CC(ic  ,1,k));
+      PM(tr2,tr9 ,CC(i-1, 4,k),CC(ic-1,3,k));
+      PM(ti9 ,ti2,CC(i  , 4,k),CC(ic  ,3,k));
+      PM(tr3,tr8 ,CC(i-1, 6,k),CC(ic-1,5,k));
+      PM(ti8 ,ti3,CC(i  , 6,k),CC(ic  ,5,k));
+      PM(tr4,tr7 ,CC(i-1, 8,k),CC(ic-1,7,k));
+      PM(ti7 ,ti4,CC(i  , 8,k),CC(ic  ,7,k));
+      PM(tr5,tr6 ,CC(i-1,10,k),CC(ic-1,9,k));
+      PM(ti6 ,ti5,CC(i  ,10,k),CC(ic  ,9,k));
+      CH(i-1,k,0)=CC(i-1,0,k)+tr1+tr2+tr3+tr4+tr5;
+      CH(i  ,k,0)=CC(i  ,0,k)+ti1+ti2+ti3+ti4+ti5;
+      POCKETFFT_RADB11STEP(1,10,tw1r,tw2r,tw3r,tw4r,tw5r,
+                                tw1i,tw2i,tw3i,tw4i,tw5i)
+      POCKETFFT_RADB11STEP(2,9,tw2r,tw4r,tw5r,tw3r,tw1r,
+                               tw2i,tw4i,-tw5i,-tw3i,-tw1i)
+      POCKETFFT_RADB11STEP(3,8,tw3r,tw5r,tw2r,tw1r,tw4r,
+                               tw3i,-tw5i,-tw2i,tw1i,tw4i)
+      POCKETFFT_RADB11STEP(4,7,tw4r,tw3r,tw1r,tw5r,tw2r,
+                               tw4i,-tw3i,tw1i,tw5i,-tw2i)
+      POCKETFFT_RADB11STEP(5,6,tw5r,tw1r,tw4r,tw2r,tw3r,
+                               tw5i,-tw1i,tw4i,-tw2i,tw3i)
+      }
+  }
+
+#undef POCKETFFT_RADB11STEP
+#undef POCKETFFT_RADB11STEP0
+
 template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
   T * POCKETFFT_RESTRICT cc, T * POCKETFFT_RESTRICT ch,
   const T0 * POCKETFFT_RESTRICT wa, const T0 * POCKETFFT_RESTRICT csarr) const
@@ -2192,29 +3453,79 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
     }
   }
 
-    template<typename T> void copy_and_norm(T *c, T *p1, T0 fct) const
+    /* runs the pass for factor fact[k] if there is a codelet for it */
+    template<bool scale, typename T> bool radf_codelet(size_t k, size_t ido,
+      size_t l1, const T *p1, T *p2, T0 fct) const
       {
-      if (p1!=c)
+      const T0 *tw = fact[k].tw;
+      switch (fact[k].fct)
         {
-        if (fct!=1.)
-          for (size_t i=0; i<length; ++i)
-            c[i] = fct*p1[i];
-        else
-          std::copy_n (p1, length, c);
+        case 4: radf4<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 8: radf8<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 2: radf2<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 3: radf3<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 5: radf5<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 7: radf7<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 11: radf11<scale>(ido, l1, p1, p2, tw, fct); return true;
+        default: return false;
+        }
+      }
+    template<bool scale, typename T> bool radb_codelet(size_t k, size_t ido,
+      size_t l1, const T *p1, T *p2, T0 fct) const
+      {
+      const T0 *tw = fact[k].tw;
+      switch (fact[k].fct)
+        {
+        case 4: radb4<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 8: radb8<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 2: radb2<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 3: radb3<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 5: radb5<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 7: radb7<scale>(ido, l1, p1, p2, tw, fct); return true;
+        case 11: radb11<scale>(ido, l1, p1, p2, tw, fct); return true;
+        default: return false;
         }
-      else
-        if (fct!=1.)
-          for (size_t i=0; i<length; ++i)
-            c[i] *= fct;
+      }
+
+    /* number of passes that move the data to another buffer; radfg leaves
+       its result in place */
+    size_t moving_passes(bool r2hc) const
+      {
+      size_t res=0;
+      for (const auto &f: fact)
+        if (!(r2hc && generic_factor(f.fct))) ++res;
+      return res;
       }
 
   public:
-    template<typename T> void exec(T c[], T0 fct, bool r2hc) const
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
+      {
+      for (bool r2hc: {false, true})
+        {
+        size_t nmove=moving_passes(r2hc);
+        if ((nmove>1) && (nmove&1)) return 2*length;
+        }
+      return length;
+      }
+
+    /* As in cfftp, fct is applied by the last pass that has a codelet, and
+       the passes are run such that the last one writes to `out`. */
+    template<typename T> void exec(const T in[], T out[], T0 fct, bool r2hc,
+      T *buf) const
       {
-      if (length==1) { c[0]*=fct; return; }
+      if (length==1) { out[0]=in[0]*fct; return; }
       size_t nf=fact.size();
-      arr<T> ch(length);
-      T *p1=c, *p2=ch.data();
+      pass_buffers<T> pb(in, out, buf, buf+length, length,
+        moving_passes(r2hc));
+      /* index of the scaling pass; the forward passes run backwards */
+      size_t kscale=nf;
+      if (fct!=1.)
+        for (size_t k1=0; k1<nf; ++k1)
+          {
+          size_t k = r2hc ? k1 : nf-1-k1;
+          if (!generic_factor(fact[k].fct)) { kscale=k; break; }
+          }
 
       if (r2hc)
         for(size_t k1=0, l1=length; k1<nf;++k1)
@@ -2223,60 +3534,106 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
           size_t ip=fact[k].fct;
           size_t ido=length / l1;
           l1 /= ip;
-          if(ip==4)
-            radf4(ido, l1, p1, p2, fact[k].tw);
-          else if(ip==2)
-            radf2(ido, l1, p1, p2, fact[k].tw);
-          else if(ip==3)
-            radf3(ido, l1, p1, p2, fact[k].tw);
-          else if(ip==5)
-            radf5(ido, l1, p1, p2, fact[k].tw);
+          if (generic_factor(ip))
+            {
+            T *p1=pb.writable();
+            radfg(ido, ip, l1, p1, pb.scratch(), fact[k].tw, fact[k].tws);
+            }
           else
-            { radfg(ido, ip, l1, p1, p2, fact[k].tw, fact[k].tws); std::swap (p1,p2); }
-          std::swap (p1,p2);
+            {
+            T *p2=pb.dst();
+            if (k==kscale)
+              radf_codelet<true>(k, ido, l1, pb.src(), p2, fct);
+            else
+              radf_codelet<false>(k, ido, l1, pb.src(), p2, fct);
+            pb.moved(p2);
+            }
           }
       else
         for(size_t k=0, l1=1; k<nf; k++)
           {
           size_t ip = fact[k].fct,
                  ido= length/(ip*l1);
-          if(ip==4)
-            radb4(ido, l1, p1, p2, fact[k].tw);
-          else if(ip==2)
-            radb2(ido, l1, p1, p2, fact[k].tw);
-          else if(ip==3)
-            radb3(ido, l1, p1, p2, fact[k].tw);
-          else if(ip==5)
-            radb5(ido, l1, p1, p2, fact[k].tw);
-          else
+          T *p2=pb.dst();
+          if (generic_factor(ip))
+            {
+            /* radbg also overwrites its input */
+            T *p1=pb.writable();
             radbg(ido, ip, l1, p1, p2, fact[k].tw, fact[k].tws);
-          std::swap (p1,p2);
+            }
+          else if (k==kscale)
+            radb_codelet<true>(k, ido, l1, pb.src(), p2, fct);
+          else
+            radb_codelet<false>(k, ido, l1, pb.src(), p2, fct);
+          pb.moved(p2);
           l1*=ip;
           }
 
-      copy_and_norm(c,p1,fct);
+      if ((kscale==nf) && (fct!=1.))
+        for (size_t i=0; i<length; ++i)
+          out[i]*=fct;
+      }
+    template<typename T> void exec(T c[], T0 fct, bool r2hc, T *buf) const
+      { exec(c, c, fct, r2hc, buf); }
+    template<typename T> void exec(T c[], T0 fct, bool r2hc) const
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, r2hc, buf.data());
       }
 
-  private:
-    void factorize()
+    /* default factorization used by the constructor; powers of two are
+       split into factors of at most `maxpow2` (2, 4 or 8) */
+    static POCKETFFT_NOINLINE std::vector<size_t> factorize(size_t len,
+      size_t maxpow2=8)
       {
-      size_t len=length;
-      while ((len%4)==0)
-        { add_factor(4); len>>=2; }
-      if ((len%2)==0)
+      std::vector<size_t> res;
+      for (size_t ip=maxpow2; ip>=4; ip>>=1)
+        while ((len&(ip-1))==0)
+          { res.push_back(ip); len/=ip; }
+      while ((len%2)==0)
         {
         len>>=1;
         // factor 2 should be at the front of the factor list
-        add_factor(2);
-        std::swap(fact[0].fct, fact.back().fct);
+        res.push_back(2);
+        std::swap(res[0], res.back());
         }
       for (size_t divisor=3; divisor*divisor<=len; divisor+=2)
         while ((len%divisor)==0)
           {
-          add_factor(divisor);
+          res.push_back(divisor);
           len/=divisor;
           }
-      if (len>1) add_factor(len);
+      if (len>1) res.push_back(len);
+      return res;
+      }
+
+    /* the passes for odd factors cannot handle an even `ido`, so all even
+       factors have to come before the odd ones */
+    static bool evens_first(const std::vector<size_t> &factors)
+      {
+      return std::is_partitioned(factors.begin(), factors.end(),
+        [](size_t ip) { return (ip&1)==0; });
+      }
+
+  private:
+    /* factors which need the extra twiddles of radfg()/radbg() */
+    static bool generic_factor(size_t ip)
+      { return (ip>5) && (ip!=7) && (ip!=8) && (ip!=11); }
+
+    bool factors_valid() const
+      {
+      size_t prod=1;
+      bool odd=false;
+      for (const auto &f: fact)
+        {
+        size_t ip=f.fct;
+        if ((ip<2) || (((ip&1)==0) && (odd || ((ip!=2) && (ip!=4) && (ip!=8))))
+          || (length%(prod*ip)!=0))
+          return false;
+        odd = odd || (ip&1);
+        prod*=ip;
+        }
+      return prod==length;
       }
 
     size_t twsize() const
@@ -2286,23 +3643,37 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
         {
         size_t ip=fact[k].fct, ido=length/(l1*ip);
         twsz+=(ip-1)*(ido-1);
-        if (ip>5) twsz+=2*ip;
+        if (generic_factor(ip)) twsz+=2*ip;
         l1*=ip;
         }
       return twsz;
       }
 
+    void assign_twiddle()
+      {
+      size_t l1=1;
+      T0 *ptr=twd;
+      for (size_t k=0; k<fact.size(); ++k)
+        {
+        size_t ip=fact[k].fct, ido=length/(l1*ip);
+        if (k<fact.size()-1) // last factor doesn't need twiddles
+          { fact[k].tw=ptr; ptr+=(ip-1)*(ido-1); }
+        if (generic_factor(ip)) // special factors required by *g functions
+          { fact[k].tws=ptr; ptr+=2*ip; }
+        l1*=ip;
+        }
+      }
+
     void comp_twiddle()
       {
+      assign_twiddle();
       sincos_2pibyn<T0> twid(length);
       size_t l1=1;
-      T0 *ptr=mem.data();
       for (size_t k=0; k<fact.size(); ++k)
         {
         size_t ip=fact[k].fct, ido=length/(l1*ip);
         if (k<fact.size()-1) // last factor doesn't need twiddles
           {
-          fact[k].tw=ptr; ptr+=(ip-1)*(ido-1);
           for (size_t j=1; j<ip; ++j)
             for (size_t i=1; i<=(ido-1)/2; ++i)
               {
@@ -2310,9 +3681,8 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
               fact[k].tw[(j-1)*(ido-1)+2*i-1] = twid[j*l1*i].i;
               }
           }
-        if (ip>5) // special factors required by *g functions
+        if (generic_factor(ip)) // special factors required by *g functions
           {
-          fact[k].tws=ptr; ptr+=2*ip;
           fact[k].tws[0] = 1.;
           fact[k].tws[1] = 0.;
           for (size_t i=2, ic=2*ip-2; i<=ic; i+=2, ic-=2)
@@ -2329,14 +3699,57 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
 
   public:
     POCKETFFT_NOINLINE rfftp(size_t length_)
-      : length(length_)
+      : length(length_), twd(nullptr)
       {
       if (length==0) throw std::runtime_error("zero-length FFT requested");
       if (length==1) return;
-      factorize();
+      for (auto f: factorize(length))
+        add_factor(f);
+      mem.resize(twsize());
+      twd = mem.data();
+      comp_twiddle();
+      }
+    /* uses the given factors (in this order) instead of the default ones */
+    POCKETFFT_NOINLINE rfftp(size_t length_, const std::vector<size_t> &factors)
+      : length(length_), twd(nullptr)
+      {
+      if (length==0) throw std::runtime_error("zero-length FFT requested");
+      for (auto f: factors)
+        add_factor(f);
+      if (!factors_valid()) throw std::invalid_argument("bad factorization");
       mem.resize(twsize());
+      twd = mem.data();
       comp_twiddle();
       }
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE rfftp(plan_reader &rd)
+      : length(rd.get_size()), twd(nullptr)
+      {
+      if (length==0) throw std::runtime_error("corrupt plan data");
+      size_t nfct=rd.get_size();
+      if (nfct>64) throw std::runtime_error("corrupt plan data");
+      for (size_t k=0; k<nfct; ++k)
+        add_factor(rd.get_size());
+      if (!factors_valid()) throw std::runtime_error("corrupt plan data");
+      twd = rd.get_array<T0>(twsize());
+      ext = rd.keepalive();
+      assign_twiddle();
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(length);
+      wr.put_size(fact.size());
+      for (const auto &f: fact)
+        wr.put_size(f.fct);
+      wr.put_array(twd, twsize());
+      }
+
+    size_t len() const { return length; }
+
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      { return mem.size()*sizeof(T0) + fact.size()*sizeof(fctdata); }
 };
 
 //
@@ -2350,10 +3763,12 @@ template<typename T0> class fftblue
     cfftp<T0> plan;
     arr<cmplx<T0>> mem;
     cmplx<T0> *bk, *bkf;
+    std::shared_ptr<const void> ext; // owner of bk/bkf, if not stored in mem
 
-    template<bool fwd, typename T> void fft(cmplx<T> c[], T0 fct) const
+    template<bool fwd, typename T> void fft(cmplx<T> c[], T0 fct,
+      cmplx<T> *akf) const
       {
-      arr<cmplx<T>> akf(n2);
+      auto pbuf = akf+n2;
 
       /* initialize a_k and FFT it */
       for (size_t m=0; m<n; ++m)
@@ -2362,7 +3777,7 @@ template<typename T0> class fftblue
       for (size_t m=n; m<n2; ++m)
         akf[m]=zero;
 
-      plan.exec (akf.data(),1.,true);
+      plan.exec (akf,1.,true,pbuf);
 
       /* do the convolution */
       akf[0] = akf[0].template special_mul<!fwd>(bkf[0]);
@@ -2375,7 +3790,7 @@ template<typename T0> class fftblue
         akf[n2/2] = akf[n2/2].template special_mul<!fwd>(bkf[n2/2]);
 
       /* inverse FFT */
-      plan.exec (akf.data(),1.,false);
+      plan.exec (akf,1.,false,pbuf);
 
       /* multiply by b_k */
       for (size_t m=0; m<n; ++m)
@@ -2384,9 +3799,13 @@ template<typename T0> class fftblue
 
   public:
     POCKETFFT_NOINLINE fftblue(size_t length)
-      : n(length), n2(util::good_size_cmplx(n*2-1)), plan(n2), mem(n+n2/2+1),
+      : fftblue(length, util::good_size_cmplx(length*2-1)) {}
+    /* uses a convolution of length n2_ (which must be at least 2*length-1) */
+    POCKETFFT_NOINLINE fftblue(size_t length, size_t n2_)
+      : n(length), n2(n2_), plan(n2), mem(n+n2/2+1),
         bk(mem.data()), bkf(mem.data()+n)
       {
+      if (n2<2*n-1) throw std::invalid_argument("Bluestein length too short");
       /* initialize b_k */
       sincos_2pibyn<T0> tmp(2*n);
       bk[0].Set(1, 0);
@@ -2411,1009 +3830,4740 @@ template<typename T0> class fftblue
       for (size_t i=0; i<n2/2+1; ++i)
         bkf[i] = tbkf[i];
       }
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE fftblue(plan_reader &rd)
+      : n(rd.get_size()), n2(rd.get_size()), plan(rd)
+      {
+      if ((n==0) || (n2<2*n-1) || (plan.len()!=n2))
+        throw std::runtime_error("corrupt plan data");
+      bk = rd.get_array<cmplx<T0>>(n+n2/2+1);
+      bkf = bk+n;
+      ext = rd.keepalive();
+      }
 
-    template<typename T> void exec(cmplx<T> c[], T0 fct, bool fwd) const
-      { fwd ? fft<true>(c,fct) : fft<false>(c,fct); }
-
-    template<typename T> void exec_r(T c[], T0 fct, bool fwd)
+    void serialize(plan_writer &wr) const
       {
-      arr<cmplx<T>> tmp(n);
-      if (fwd)
-        {
-        auto zero = T0(0)*c[0];
-        for (size_t m=0; m<n; ++m)
-          tmp[m].Set(c[m], zero);
-        fft<true>(tmp.data(),fct);
-        c[0] = tmp[0].r;
-        std::copy_n (&tmp[1].r, n-1, &c[1]);
-        }
-      else
-        {
-        tmp[0].Set(c[0],c[0]*0);
-        std::copy_n (c+1, n-1, &tmp[1].r);
-        if ((n&1)==0) tmp[n/2].i=T0(0)*c[0];
-        for (size_t m=1; 2*m<n; ++m)
-          tmp[n-m].Set(tmp[m].r, -tmp[m].i);
-        fft<false>(tmp.data(),fct);
-        for (size_t m=0; m<n; ++m)
-          c[m] = tmp[m].r;
-        }
+      wr.put_size(n);
+      wr.put_size(n2);
+      plan.serialize(wr);
+      wr.put_array(bk, n+n2/2+1);
       }
+
+    size_t length() const { return n; }
+
+    /* scratch space needed by exec(), in units of cmplx<T> */
+    size_t workspace_size() const { return n2+plan.workspace_size(); }
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      { return mem.size()*sizeof(cmplx<T0>) + plan.memory_size(); }
+
+    template<typename T> void exec(cmplx<T> c[], T0 fct, bool fwd,
+      cmplx<T> *buf) const
+      { fwd ? fft<true>(c,fct,buf) : fft<false>(c,fct,buf); }
   };
 
-//
-// flexible (FFTPACK/Bluestein) complex 1D transform
-//
+/* Post-processing step of a real FFT of even length n computed as a complex
+   FFT of length n/2 of the packed data z[m]=(c[2m],c[2m+1]): writes the
+   spectrum in FFTPACK halfcomplex order to c. tw[k]=exp(-2*pi*i*k/n) for
+   k<=n/4. */
+template<typename T, typename T0> void hc_from_half(const cmplx<T> *z, T c[],
+  const cmplx<T0> *tw, size_t n)
+  {
+  size_t nh = n/2;
+  c[0] = z[0].r+z[0].i;
+  c[n-1] = z[0].r-z[0].i;
+  for (size_t k=1, kc=nh-1; k<=kc; ++k, --kc)
+    {
+    auto a = z[k], b = conj(z[kc]);
+    auto e = (a+b)*T0(0.5), d = (a-b)*T0(0.5);
+    cmplx<T> t(d.i, -d.r); // (a-b)/(2i)
+    t = t*tw[k];
+    c[2*k-1] = e.r+t.r; c[2*k] = e.i+t.i;
+    if (k!=kc)
+      { c[2*kc-1] = e.r-t.r; c[2*kc] = t.i-e.i; }
+    }
+  }
+/* inverse of hc_from_half() up to a factor of 2, for the backward
+   transform */
+template<typename T, typename T0> void half_from_hc(const T c[],
+  cmplx<T> *z, const cmplx<T0> *tw, size_t n)
+  {
+  size_t nh = n/2;
+  z[0].Set(c[0]+c[n-1], c[0]-c[n-1]);
+  for (size_t k=1, kc=nh-1; k<=kc; ++k, --kc)
+    {
+    cmplx<T> a(c[2*k-1], c[2*k]),
+             b = (k==kc) ? conj(a) : cmplx<T>(c[2*kc-1], -c[2*kc]);
+    auto e = a+b, d = (a-b).template special_mul<true>(tw[k]);
+    z[k].Set(e.r-d.i, e.i+d.r); // e + i*d
+    if (k!=kc)
+      z[kc].Set(e.r+d.i, d.r-e.i); // conj(e) + i*conj(d)
+    }
+  }
 
-template<typename T0> class pocketfft_c
+/* Bluestein's algorithm for real data, at about half the cost of the complex
+   algorithm. For even n, the data is treated as a complex array of length
+   n/2, which is transformed with fftblue; the spectrum is obtained from that
+   in a post-processing step (and vice versa for the backward transform).
+   For odd n, only the (n+1)/2 independent outputs (forward) or inputs
+   (backward) take part in the convolution, which shortens it from 2n-1 to
+   n+(n-1)/2. */
+template<typename T0> class fftblue_r
   {
   private:
-    std::unique_ptr<cfftp<T0>> packplan;
-    std::unique_ptr<fftblue<T0>> blueplan;
-    size_t len;
+    size_t n, n2;
+    std::unique_ptr<fftblue<T0>> half; // even n
+    std::unique_ptr<cfftp<T0>> plan;   // odd n
+    arr<cmplx<T0>> mem;
+    /* even n: tw[k] = exp(-2*pi*i*k/n), k<=n/4;
+       odd n: b_k and the Fourier transformed, zero-padded b_k */
+    const cmplx<T0> *tw, *bk, *bkf=nullptr;
+    std::shared_ptr<const void> ext; // owner of the tables, if not in mem
 
-  public:
-    POCKETFFT_NOINLINE pocketfft_c(size_t length)
-      : len(length)
+    size_t table_size() const { return (n&1) ? n+n2 : n/4+1; }
+
+    template<typename T> void fwd_even(T c[], T0 fct, T *buf) const
       {
-      if (length==0) throw std::runtime_error("zero-length FFT requested");
-      size_t tmp = (length<50) ? 0 : util::largest_prime_factor(length);
-      if (tmp*tmp <= length)
+      size_t nh = n/2;
+      auto z = reinterpret_cast<cmplx<T> *>(buf);
+      for (size_t m=0; m<nh; ++m)
+        z[m].Set(c[2*m], c[2*m+1]);
+      half->exec(z, fct, true, z+nh);
+      hc_from_half(z, c, tw, n);
+      }
+    template<typename T> void bwd_even(T c[], T0 fct, T *buf) const
+      {
+      size_t nh = n/2;
+      auto z = reinterpret_cast<cmplx<T> *>(buf);
+      half_from_hc(c, z, tw, n);
+      half->exec(z, fct, false, z+nh);
+      for (size_t m=0; m<nh; ++m)
+        { c[2*m] = z[m].r; c[2*m+1] = z[m].i; }
+      }
+
+    /* forward: the convolution uses b_j for -n<j<=(n-1)/2, which are stored
+       at j mod n2; backward: -(n-1)/2<=j<n, whose transform is bkf[-k] */
+    template<typename T> void fwd_odd(T c[], T0 fct, T *buf) const
+      {
+      auto akf = reinterpret_cast<cmplx<T> *>(buf);
+      for (size_t m=0; m<n; ++m)
+        akf[m].Set(c[m]*bk[m].r, -c[m]*bk[m].i);
+      auto zero = akf[0]*T0(0);
+      for (size_t m=n; m<n2; ++m)
+        akf[m] = zero;
+      plan->exec(akf, T0(1), true, akf+n2);
+      for (size_t m=0; m<n2; ++m)
+        akf[m] = akf[m]*bkf[m];
+      plan->exec(akf, T0(1), false, akf+n2);
+      c[0] = akf[0].r*fct;
+      for (size_t k=1; 2*k<n; ++k)
         {
-        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
-        return;
+        auto x = akf[k].template special_mul<true>(bk[k]);
+        c[2*k-1] = x.r*fct;
+        c[2*k] = x.i*fct;
         }
-      double comp1 = util::cost_guess(length);
-      double comp2 = 2*util::cost_guess(util::good_size_cmplx(2*length-1));
-      comp2*=1.5; /* fudge factor that appears to give good overall performance */
-      if (comp2<comp1) // use Bluestein
-        blueplan=std::unique_ptr<fftblue<T0>>(new fftblue<T0>(length));
-      else
-        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
       }
-
-    template<typename T> POCKETFFT_NOINLINE void exec(cmplx<T> c[], T0 fct, bool fwd) const
-      { packplan ? packplan->exec(c,fct,fwd) : blueplan->exec(c,fct,fwd); }
-
-    size_t length() const { return len; }
-  };
-
-//
-// flexible (FFTPACK/Bluestein) real-valued 1D transform
-//
-
-template<typename T0> class pocketfft_r
-  {
-  private:
-    std::unique_ptr<rfftp<T0>> packplan;
-    std::unique_ptr<fftblue<T0>> blueplan;
-    size_t len;
+    template<typename T> void bwd_odd(T c[], T0 fct, T *buf) const
+      {
+      auto akf = reinterpret_cast<cmplx<T> *>(buf);
+      akf[0].Set(c[0], c[0]*T0(0));
+      for (size_t k=1; 2*k<n; ++k)
+        {
+        auto x = cmplx<T>(c[2*k-1], c[2*k])*bk[k];
+        akf[k].Set(x.r*T0(2), -x.i*T0(2));
+        }
+      auto zero = akf[0]*T0(0);
+      for (size_t m=(n+1)/2; m<n2; ++m)
+        akf[m] = zero;
+      plan->exec(akf, T0(1), true, akf+n2);
+      akf[0] = akf[0]*bkf[0];
+      for (size_t m=1; m<n2; ++m)
+        akf[m] = akf[m]*bkf[n2-m];
+      plan->exec(akf, T0(1), false, akf+n2);
+      for (size_t m=0; m<n; ++m)
+        c[m] = (akf[m].r*bk[m].r+akf[m].i*bk[m].i)*fct;
+      }
 
   public:
-    POCKETFFT_NOINLINE pocketfft_r(size_t length)
-      : len(length)
+    /* the shortest admissible convolution length for length n */
+    static size_t min_conv_length(size_t n)
+      { return (n&1) ? n+n/2 : std::max<size_t>(n, 2)-1; }
+
+    POCKETFFT_NOINLINE fftblue_r(size_t length)
+      : fftblue_r(length, util::good_size_cmplx(min_conv_length(length))) {}
+    /* uses a convolution of length n2_ (at least min_conv_length(length)) */
+    POCKETFFT_NOINLINE fftblue_r(size_t length, size_t n2_)
+      : n(length), n2(n2_)
       {
-      if (length==0) throw std::runtime_error("zero-length FFT requested");
-      size_t tmp = (length<50) ? 0 : util::largest_prime_factor(length);
-      if (tmp*tmp <= length)
+      if (n2<min_conv_length(n))
+        throw std::invalid_argument("Bluestein length too short");
+      mem.resize(table_size());
+      tw = bk = mem.data();
+      if ((n&1)==0)
         {
-        packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
+        half.reset(new fftblue<T0>(n/2, n2));
+        sincos_2pibyn<T0> roots(n);
+        for (size_t k=0; k<mem.size(); ++k)
+          mem[k] = conj(roots[k]);
         return;
         }
-      double comp1 = 0.5*util::cost_guess(length);
-      double comp2 = 2*util::cost_guess(util::good_size_cmplx(2*length-1));
-      comp2*=1.5; /* fudge factor that appears to give good overall performance */
-      if (comp2<comp1) // use Bluestein
-        blueplan=std::unique_ptr<fftblue<T0>>(new fftblue<T0>(length));
+      plan.reset(new cfftp<T0>(n2));
+      auto b = mem.data();
+      sincos_2pibyn<T0> tmp(2*n);
+      b[0].Set(1, 0);
+      for (size_t m=1, coeff=0; m<n; ++m)
+        {
+        coeff+=2*m-1;
+        if (coeff>=2*n) coeff-=2*n;
+        b[m] = tmp[coeff];
+        }
+      auto tbkf = b+n;
+      T0 xn2 = T0(1)/T0(n2);
+      for (size_t m=0; m<n2; ++m)
+        tbkf[m].Set(0, 0);
+      for (size_t m=0; 2*m<n; ++m)
+        tbkf[m] = b[m]*xn2;
+      for (size_t m=1; m<n; ++m)
+        tbkf[n2-m] = b[m]*xn2;
+      plan->exec(tbkf, T0(1), true);
+      bkf = tbkf;
+      }
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE fftblue_r(plan_reader &rd)
+      : n(rd.get_size()), n2(rd.get_size())
+      {
+      if ((n==0) || (n2<min_conv_length(n)))
+        throw std::runtime_error("corrupt plan data");
+      if ((n&1)==0)
+        {
+        half.reset(new fftblue<T0>(rd));
+        if (half->length()!=n/2) throw std::runtime_error("corrupt plan data");
+        }
       else
-        packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
+        {
+        plan.reset(new cfftp<T0>(rd));
+        if (plan->len()!=n2) throw std::runtime_error("corrupt plan data");
+        }
+      tw = bk = rd.get_array<cmplx<T0>>(table_size());
+      if (n&1) bkf = bk+n;
+      ext = rd.keepalive();
       }
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool fwd) const
-      { packplan ? packplan->exec(c,fct,fwd) : blueplan->exec_r(c,fct,fwd); }
-
-    size_t length() const { return len; }
-  };
-
-
-//
-// sine/cosine transforms
-//
-
-template<typename T0> class T_dct1
-  {
-  private:
-    pocketfft_r<T0> fftplan;
-
-  public:
-    POCKETFFT_NOINLINE T_dct1(size_t length)
-      : fftplan(2*(length-1)) {}
-
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
-      int /*type*/, bool /*cosine*/) const
+    void serialize(plan_writer &wr) const
       {
-      constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
-      size_t N=fftplan.length(), n=N/2+1;
-      if (ortho)
-        { c[0]*=sqrt2; c[n-1]*=sqrt2; }
-      arr<T> tmp(N);
-      tmp[0] = c[0];
-      for (size_t i=1; i<n; ++i)
-        tmp[i] = tmp[N-i] = c[i];
-      fftplan.exec(tmp.data(), fct, true);
-      c[0] = tmp[0];
-      for (size_t i=1; i<n; ++i)
-        c[i] = tmp[2*i-1];
-      if (ortho)
-        { c[0]*=sqrt2*T0(0.5); c[n-1]*=sqrt2*T0(0.5); }
+      wr.put_size(n);
+      wr.put_size(n2);
+      half ? half->serialize(wr) : plan->serialize(wr);
+      wr.put_array(bk, table_size());
       }
 
-    size_t length() const { return fftplan.length()/2+1; }
-  };
-
-template<typename T0> class T_dst1
-  {
-  private:
-    pocketfft_r<T0> fftplan;
-
-  public:
-    POCKETFFT_NOINLINE T_dst1(size_t length)
-      : fftplan(2*(length+1)) {}
+    size_t length() const { return n; }
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct,
-      bool /*ortho*/, int /*type*/, bool /*cosine*/) const
+    /* scratch space needed by exec(), in units of T */
+    size_t workspace_size() const
       {
-      size_t N=fftplan.length(), n=N/2-1;
-      arr<T> tmp(N);
-      tmp[0] = tmp[n+1] = c[0]*0;
-      for (size_t i=0; i<n; ++i)
-        { tmp[i+1]=c[i]; tmp[N-1-i]=-c[i]; }
-      fftplan.exec(tmp.data(), fct, true);
-      for (size_t i=0; i<n; ++i)
-        c[i] = -tmp[2*i+2];
+      return half ? n+2*half->workspace_size()
+                  : 2*(n2+plan->workspace_size());
+      }
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      {
+      return mem.size()*sizeof(cmplx<T0>)
+        + (half ? sizeof(*half) + half->memory_size()
+                : sizeof(*plan) + plan->memory_size());
       }
 
-    size_t length() const { return fftplan.length()/2-1; }
+    template<typename T> void exec(T c[], T0 fct, bool fwd, T *buf) const
+      {
+      if (n&1)
+        fwd ? fwd_odd(c, fct, buf) : bwd_odd(c, fct, buf);
+      else
+        fwd ? fwd_even(c, fct, buf) : bwd_even(c, fct, buf);
+      }
   };
 
-template<typename T0> class T_dcst23
+//
+// complex transforms split into two shorter ones
+//
+
+/* vector type holding VLEN lines of scalar type T; T itself otherwise */
+template<typename T> struct line_vec { using type = T; };
+#ifndef POCKETFFT_NO_VECTORS
+template<> struct line_vec<float> { using type = vtype_t<float>; };
+template<> struct line_vec<double> { using type = vtype_t<double>; };
+#endif
+
+/* FFT of length n=n1*n2 via the "four-step" algorithm: the input is viewed as
+   an n1 x n2 matrix; its n2 columns are transformed (length n1), multiplied by
+   twiddle factors, and its n1 rows are transformed (length n2) and stored
+   transposed. For scalar data, the short FFTs run on VLEN columns or rows at
+   once, so that a single long transform makes use of the SIMD units. */
+template<typename T0> class fftsplit
   {
   private:
-    pocketfft_r<T0> fftplan;
-    std::vector<T0> twiddle;
-
-  public:
-    POCKETFFT_NOINLINE T_dcst23(size_t length)
-      : fftplan(length), twiddle(length)
+    size_t n, n1, n2, blk;
+    cfftp<T0> plan1, plan2;
+    sincos_2pibyn<T0> roots;
+    arr<cmplx<T0>> tw;
+
+    template<typename T> static void load(cmplx<T> &dst, const cmplx<T> *src,
+      size_t)
+      { dst = src[0]; }
+    template<typename T> static void store(cmplx<T> *dst, const cmplx<T> &src,
+      size_t)
+      { dst[0] = src; }
+#ifndef POCKETFFT_NO_VECTORS
+    /* the lanes are assembled in local variables, which lets the compiler
+       use vector permutations for contiguous data */
+    template<typename T> static void load(cmplx<vtype_t<T>> &dst,
+      const cmplx<T> *src, size_t stride)
       {
-      sincos_2pibyn<T0> tw(4*length);
-      for (size_t i=0; i<length; ++i)
-        twiddle[i] = tw[i+1].r;
+      vtype_t<T> r{}, i{};
+      for (size_t l=0; l<VLEN<T>::val; ++l)
+        { r[l]=src[l*stride].r; i[l]=src[l*stride].i; }
+      dst.r=r; dst.i=i;
       }
+    template<typename T> static void store(cmplx<T> *dst,
+      const cmplx<vtype_t<T>> &src, size_t stride)
+      {
+      vtype_t<T> r=src.r, i=src.i;
+      for (size_t l=0; l<VLEN<T>::val; ++l)
+        dst[l*stride].Set(r[l], i[l]);
+      }
+#endif
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
-      int type, bool cosine) const
+    /* The twiddle factor for row k1 and column j+l is
+       W_n^(k1*j) * W_n^(k1*l); the second factor is tabulated for l<VLEN,
+       real parts first, so that a table row can be used directly as
+       cmplx<vtype_t<T0>>. */
+    template<bool fwd, typename V> void twmul(cmplx<V> *a, size_t j,
+      std::true_type) const
       {
-      constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
-      size_t N=length();
-      size_t NS2 = (N+1)/2;
-      if (type==2)
+      for (size_t k1=1, idx=j; k1<n1; ++k1, idx+=j)
         {
-        if (!cosine)
-          for (size_t k=1; k<N; k+=2)
-            c[k] = -c[k];
-        c[0] *= 2;
-        if ((N&1)==0) c[N-1]*=2;
-        for (size_t k=1; k<N-1; k+=2)
-          MPINPLACE(c[k+1], c[k]);
-        fftplan.exec(c, fct, false);
-        for (size_t k=1, kc=N-1; k<NS2; ++k, --kc)
-          {
-          T t1 = twiddle[k-1]*c[kc]+twiddle[kc-1]*c[k];
-          T t2 = twiddle[k-1]*c[k]-twiddle[kc-1]*c[kc];
-          c[k] = T0(0.5)*(t1+t2); c[kc]=T0(0.5)*(t1-t2);
-          }
-        if ((N&1)==0)
-          c[NS2] *= twiddle[NS2-1];
-        if (!cosine)
-          for (size_t k=0, kc=N-1; k<kc; ++k, --kc)
-            std::swap(c[k], c[kc]);
-        if (ortho) c[0]*=sqrt2*T0(0.5);
+        if (idx>=n) idx-=n;
+        special_mul<fwd>(a[k1], roots[idx], a[k1]);
         }
-      else
+      }
+    template<bool fwd, typename V> void twmul(cmplx<V> *a, size_t j,
+      std::false_type) const
+      {
+      auto p = reinterpret_cast<const cmplx<V> *>(tw.data());
+      for (size_t k1=1, idx=j; k1<n1; ++k1, idx+=j)
         {
-        if (ortho) c[0]*=sqrt2;
-        if (!cosine)
-          for (size_t k=0, kc=N-1; k<NS2; ++k, --kc)
-            std::swap(c[k], c[kc]);
-        for (size_t k=1, kc=N-1; k<NS2; ++k, --kc)
+        if (idx>=n) idx-=n;
+        special_mul<fwd>(a[k1], p[k1]*roots[idx], a[k1]);
+        }
+      }
+
+    void comp_twiddle()
+      {
+      constexpr size_t vlen = VLEN<T0>::val;
+      tw.resize(n1*vlen);
+      auto p = &tw[0].r;
+      for (size_t k1=0; k1<n1; ++k1)
+        for (size_t l=0, idx=0; l<vlen; ++l, idx+=k1)
           {
-          T t1=c[k]+c[kc], t2=c[k]-c[kc];
-          c[k] = twiddle[k-1]*t2+twiddle[kc-1]*t1;
-          c[kc]= twiddle[k-1]*t1-twiddle[kc-1]*t2;
+          auto w = roots[idx%n];
+          p[2*k1*vlen+l] = w.r;
+          p[2*k1*vlen+vlen+l] = w.i;
           }
-        if ((N&1)==0)
-          c[NS2] *= 2*twiddle[NS2-1];
-        fftplan.exec(c, fct, true);
-        for (size_t k=1; k<N-1; k+=2)
-          MPINPLACE(c[k], c[k+1]);
-        if (!cosine)
-          for (size_t k=1; k<N; k+=2)
-            c[k] = -c[k];
-        }
       }
 
-    size_t length() const { return fftplan.length(); }
-  };
+    /* Width of the panels in which the passes move data that does not fit
+       into the L2 cache, or 0 if the data is accessed directly. Copying
+       panels of 2 KiB per row keeps the strided accesses within the cache. */
+    static size_t panel_width(size_t n1, size_t n2)
+      {
+      if (n1*n2*sizeof(cmplx<T0>) <= (size_t(1)<<23)) return 0;
+      for (size_t b=2048/sizeof(cmplx<T0>); b>VLEN<T0>::val; b>>=1)
+        if ((n1%b==0) && (n2%b==0)) return b;
+      return 0;
+      }
 
-template<typename T0> class T_dcst4
-  {
-  private:
-    size_t N;
-    std::unique_ptr<pocketfft_c<T0>> fft;
-    std::unique_ptr<pocketfft_r<T0>> rfft;
-    arr<cmplx<T0>> C2;
+    /* transforms the columns j ... j+vl-1, whose element j1 is found at
+       src[j1*sstride], and stores them, multiplied by the twiddle factors,
+       at dst[k1*dstride] */
+    template<bool fwd, typename T, typename V> void col_fft(
+      const cmplx<T> *src, size_t sstride, cmplx<T> *dst, size_t dstride,
+      size_t j, cmplx<V> *a, cmplx<V> *scratch) const
+      {
+      constexpr size_t vl = sizeof(V)/sizeof(T);
+      for (size_t j1=0; j1<n1; ++j1)
+        load(a[j1], src+sstride*j1, 1);
+      plan1.exec(a, T0(1), fwd, scratch);
+      twmul<fwd>(a, j, std::integral_constant<bool, vl==1>());
+      for (size_t k1=0; k1<n1; ++k1)
+        store(dst+dstride*k1, a[k1], 1);
+      }
+    /* transforms the rows k ... k+vl-1 of buf, starting at src, and stores
+       element k2 at dst[k2*dstride] */
+    template<bool fwd, typename T, typename V> void row_fft(
+      const cmplx<T> *src, cmplx<T> *dst, size_t dstride, T0 fct,
+      cmplx<V> *a, cmplx<V> *scratch) const
+      {
+      for (size_t j2=0; j2<n2; ++j2)
+        load(a[j2], src+j2, n2);
+      plan2.exec(a, fct, fwd, scratch);
+      for (size_t k2=0; k2<n2; ++k2)
+        store(dst+dstride*k2, a[k2], 1);
+      }
 
-  public:
-    POCKETFFT_NOINLINE T_dcst4(size_t length)
-      : N(length),
-        fft((N&1) ? nullptr : new pocketfft_c<T0>(N/2)),
-        rfft((N&1)? new pocketfft_r<T0>(N) : nullptr),
-        C2((N&1) ? 0 : N/2)
+    /* column transforms for the columns j0 ... j0+cnt-1 */
+    template<bool fwd, typename T, typename V> void pass1(
+      const cmplx<T> *src, size_t sstride, cmplx<T> *dst, size_t dstride,
+      size_t j0, size_t cnt, cmplx<V> *a, cmplx<V> *scratch) const
       {
-      if ((N&1)==0)
-        {
-        sincos_2pibyn<T0> tw(16*N);
-        for (size_t i=0; i<N/2; ++i)
-          C2[i] = conj(tw[8*i+1]);
-        }
+      constexpr size_t vl = sizeof(V)/sizeof(T);
+      size_t j=0;
+      for (; j+vl<=cnt; j+=vl)
+        col_fft<fwd>(src+j, sstride, dst+j, dstride, j0+j, a, scratch);
+      for (; j<cnt; ++j)
+        col_fft<fwd>(src+j, sstride, dst+j, dstride, j0+j,
+          reinterpret_cast<cmplx<T> *>(a), reinterpret_cast<cmplx<T> *>(scratch));
+      }
+    /* row transforms for the rows k0 ... k0+cnt-1 of buf */
+    template<bool fwd, typename T, typename V> void pass2(
+      const cmplx<T> *buf, cmplx<T> *dst, size_t dstride, size_t k0,
+      size_t cnt, T0 fct, cmplx<V> *a, cmplx<V> *scratch) const
+      {
+      constexpr size_t vl = sizeof(V)/sizeof(T);
+      size_t k=0;
+      for (; k+vl<=cnt; k+=vl)
+        row_fft<fwd>(buf+n2*(k0+k), dst+k, dstride, fct, a, scratch);
+      for (; k<cnt; ++k)
+        row_fft<fwd>(buf+n2*(k0+k), dst+k, dstride, fct,
+          reinterpret_cast<cmplx<T> *>(a), reinterpret_cast<cmplx<T> *>(scratch));
       }
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct,
-      bool /*ortho*/, int /*type*/, bool cosine) const
+    /* Thread ithr of nthr handles the part [lo; hi) of 0 ... len-1; all
+       boundaries except len are multiples of gran. */
+    static void thread_range(size_t len, size_t gran, size_t ithr,
+      size_t nthr, size_t &lo, size_t &hi)
       {
-      size_t n2 = N/2;
-      if (!cosine)
-        for (size_t k=0, kc=N-1; k<n2; ++k, --kc)
-          std::swap(c[k], c[kc]);
-      if (N&1)
-        {
-        // The following code is derived from the FFTW3 function apply_re11()
-        // and is released under the 3-clause BSD license with friendly
-        // permission of Matteo Frigo and Steven G. Johnson.
+      size_t nchunks = len/gran;
+      lo = nchunks*ithr/nthr*gran;
+      hi = (ithr+1==nthr) ? len : nchunks*(ithr+1)/nthr*gran;
+      }
+    template<typename V, typename T> static cmplx<V> *align_vec(cmplx<T> *p)
+      {
+      constexpr size_t al = alignof(cmplx<V>);
+      auto ptr = reinterpret_cast<std::uintptr_t>(p);
+      return reinterpret_cast<cmplx<V> *>((ptr+al-1)/al*al);
+      }
 
-        arr<T> y(N);
+    /* the column transforms of thread ithr of nthr; ws points to the
+       scratch space of this thread (see workspace_size()) */
+    template<bool fwd, typename T> void columns(const cmplx<T> *c,
+      cmplx<T> *buf, cmplx<T> *ws, size_t ithr, size_t nthr) const
+      {
+      using V = typename line_vec<T>::type;
+      auto a = align_vec<V>(ws+blk*std::max(n1, n2));
+      auto scratch = a+std::max(n1, n2);
+      size_t lo, hi;
+      thread_range(n2, (blk==0) ? sizeof(V)/sizeof(T) : blk, ithr, nthr,
+        lo, hi);
+      if (blk==0)
         {
-        size_t i=0, m=n2;
-        for (; m<N; ++i, m+=4)
-          y[i] = c[m];
-        for (; m<2*N; ++i, m+=4)
-          y[i] = -c[2*N-m-1];
-        for (; m<3*N; ++i, m+=4)
-          y[i] = -c[m-2*N];
-        for (; m<4*N; ++i, m+=4)
-          y[i] = c[4*N-m-1];
-        for (; i<N; ++i, m+=4)
-          y[i] = c[m-4*N];
+        pass1<fwd>(c+lo, n2, buf+lo, n2, lo, hi-lo, a, scratch);
+        return;
         }
-        rfft->exec(y.data(), fct, true);
+      for (size_t jb=lo; jb<hi; jb+=blk)
         {
-        auto SGN = [](size_t i)
-           {
-           constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
-           return (i&2) ? -sqrt2 : sqrt2;
-           };
-        c[n2] = y[0]*SGN(n2+1);
-        size_t i=0, i1=1, k=1;
-        for (; k<n2; ++i, ++i1, k+=2)
-          {
-          c[i    ] = y[2*k-1]*SGN(i1)     + y[2*k  ]*SGN(i);
-          c[N -i1] = y[2*k-1]*SGN(N -i)   - y[2*k  ]*SGN(N -i1);
-          c[n2-i1] = y[2*k+1]*SGN(n2-i)   - y[2*k+2]*SGN(n2-i1);
-          c[n2+i1] = y[2*k+1]*SGN(n2+i+2) + y[2*k+2]*SGN(n2+i1);
-          }
-        if (k == n2)
-          {
-          c[i   ] = y[2*k-1]*SGN(i+1) + y[2*k]*SGN(i);
-          c[N-i1] = y[2*k-1]*SGN(i+2) + y[2*k]*SGN(i1);
-          }
+        for (size_t j1=0; j1<n1; ++j1)
+          std::copy_n(c+n2*j1+jb, blk, ws+blk*j1);
+        pass1<fwd>(ws, blk, ws, blk, jb, blk, a, scratch);
+        for (size_t k1=0; k1<n1; ++k1)
+          std::copy_n(ws+blk*k1, blk, buf+n2*k1+jb);
         }
-
-        // FFTW-derived code ends here
+      }
+    /* the row transforms of thread ithr of nthr */
+    template<bool fwd, typename T> void rows(cmplx<T> *c,
+      const cmplx<T> *buf, T0 fct, cmplx<T> *ws, size_t ithr, size_t nthr)
+      const
+      {
+      using V = typename line_vec<T>::type;
+      auto a = align_vec<V>(ws+blk*std::max(n1, n2));
+      auto scratch = a+std::max(n1, n2);
+      size_t lo, hi;
+      thread_range(n1, (blk==0) ? sizeof(V)/sizeof(T) : blk, ithr, nthr,
+        lo, hi);
+      if (blk==0)
+        {
+        pass2<fwd>(buf, c+lo, n1, lo, hi-lo, fct, a, scratch);
+        return;
         }
-      else
+      for (size_t kb=lo; kb<hi; kb+=blk)
         {
-        // even length algorithm from
-        // https://www.appletonaudio.com/blog/2013/derivation-of-fast-dct-4-algorithm-based-on-dft/
-        arr<cmplx<T>> y(n2);
-        for(size_t i=0; i<n2; ++i)
-          {
-          y[i].Set(c[2*i],c[N-1-2*i]);
-          y[i] *= C2[i];
-          }
-        fft->exec(y.data(), fct, true);
-        for(size_t i=0, ic=n2-1; i<n2; ++i, --ic)
-          {
-          c[2*i  ] =  2*(y[i ].r*C2[i ].r-y[i ].i*C2[i ].i);
-          c[2*i+1] = -2*(y[ic].i*C2[ic].r+y[ic].r*C2[ic].i);
-          }
+        pass2<fwd>(buf, ws, blk, kb, blk, fct, a, scratch);
+        for (size_t k2=0; k2<n2; ++k2)
+          std::copy_n(ws+blk*k2, blk, c+n1*k2+kb);
         }
-      if (!cosine)
-        for (size_t k=1; k<N; k+=2)
-          c[k] = -c[k];
       }
 
-    size_t length() const { return N; }
-  };
+    /* Both passes consist of independent transforms, which are distributed
+       over the threads; each thread allocates its own scratch space. */
+    template<bool fwd, typename T> void fft(cmplx<T> c[], T0 fct,
+      cmplx<T> *buf, size_t nthreads) const
+      {
+      if (nthreads==1)
+        {
+        columns<fwd>(c, buf, buf+n, 0, 1);
+        rows<fwd>(c, buf, fct, buf+n, 0, 1);
+        return;
+        }
+      size_t wsize = workspace_size()-n;
+      threading::thread_map(nthreads, [&] {
+        arr<cmplx<T>> ws(wsize);
+        columns<fwd>(c, buf, ws.data(), threading::thread_id(),
+          threading::num_threads());
+        });
+      threading::thread_map(nthreads, [&] {
+        arr<cmplx<T>> ws(wsize);
+        rows<fwd>(c, buf, fct, ws.data(), threading::thread_id(),
+          threading::num_threads());
+        });
+      }
+
+  public:
+    /* all admissible factors n1 for length n, closest to sqrt(n) first:
+       both factors must be multiples of VLEN and differ by at most a
+       factor of 16 */
+    static POCKETFFT_NOINLINE std::vector<size_t> splits(size_t n)
+      {
+      constexpr size_t vl = VLEN<T0>::val;
+      std::vector<size_t> res;
+      for (size_t d=size_t(std::sqrt(double(n)))+1; d*d*16>=n; --d)
+        if ((n%d==0) && (d%vl==0) && ((n/d)%vl==0) && (d>1) && (n/d>1))
+          {
+          res.push_back(d);
+          if (d*d!=n) res.push_back(n/d);
+          }
+      return res;
+      }
+    /* the first of splits(n) that allows panels if the data does not fit
+       into the L2 cache, or 0 */
+    static POCKETFFT_NOINLINE size_t first_split(size_t n)
+      {
+      for (auto d: splits(n))
+        if ((n*sizeof(cmplx<T0>)<=(size_t(1)<<23)) || (panel_width(d, n/d)!=0))
+          return d;
+      return 0;
+      }
+    /* the factor n1 used for length n, or 0 if splitting is not worthwhile.
+       With fewer than 4 lanes the extra passes over memory cost more than
+       the vectorization gains. With 4 lanes the same holds for data between
+       the L2 cache size and 64 MiB, where even the panel-wise passes are not
+       faster than the strided ones of cfftp. */
+    static POCKETFFT_NOINLINE size_t split(size_t n)
+      {
+      constexpr size_t vl = VLEN<T0>::val;
+      if ((vl<4) || (n<4096)) return 0;
+      size_t bytes = n*sizeof(cmplx<T0>);
+      if ((vl<8) && (bytes>(size_t(1)<<19)) && (bytes<(size_t(1)<<26)))
+        return 0;
+      return first_split(n);
+      }
+    /* the factor n1 used for running a transform of length n on several
+       threads, or 0 if the transform is too short to profit */
+    static POCKETFFT_NOINLINE size_t mt_split(size_t n)
+      {
+      if (n<65536) return 0;
+#ifdef POCKETFFT_NO_MULTITHREADING
+      return 0;
+#else
+      return first_split(n);
+#endif
+      }
+
+    /* splits into n1_ x (length/n1_) */
+    POCKETFFT_NOINLINE fftsplit(size_t length, size_t n1_)
+      : n(length), n1(n1_), n2((n1_==0) ? 0 : length/n1_),
+        blk(panel_width(n1, n2)), plan1(n1), plan2(n2), roots(n)
+      {
+      if ((n1<2) || (n1*n2!=n) || (n2%VLEN<T0>::val!=0))
+        throw std::invalid_argument("bad split");
+      comp_twiddle();
+      }
+    /* reconstructs a plan stored by serialize(); the twiddle factors are
+       recomputed, since their layout depends on VLEN */
+    POCKETFFT_NOINLINE fftsplit(plan_reader &rd)
+      : n(rd.get_size()), n1(rd.get_size()), n2((n1==0) ? 0 : n/n1),
+        blk(panel_width(n1, n2)), plan1(rd), plan2(rd), roots(n)
+      {
+      if ((n1<2) || (n1*n2!=n) || (n2%VLEN<T0>::val!=0)
+        || (plan1.len()!=n1) || (plan2.len()!=n2))
+        throw std::runtime_error("corrupt plan data");
+      comp_twiddle();
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(n);
+      wr.put_size(n1);
+      plan1.serialize(wr);
+      plan2.serialize(wr);
+      }
+
+    size_t length() const { return n; }
 
+    /* scratch space needed by exec(), in units of cmplx<T>, for any T */
+    size_t workspace_size() const
+      {
+      return n + (blk+VLEN<T0>::val)*std::max(n1, n2) + VLEN<T0>::val
+        *(1+std::max(plan1.workspace_size(), plan2.workspace_size()));
+      }
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      {
+      return tw.size()*sizeof(cmplx<T0>) + roots.memory_size()
+        + plan1.memory_size() + plan2.memory_size();
+      }
+
+    /* nthreads==0 uses all hardware threads */
+    template<typename T> void exec(cmplx<T> c[], T0 fct, bool fwd,
+      cmplx<T> *buf, size_t nthreads=1) const
+      {
+      fwd ? fft<true>(c,fct,buf,nthreads) : fft<false>(c,fct,buf,nthreads);
+      }
+  };
 
 //
-// multi-D infrastructure
+// planning
 //
 
-template<typename T> std::shared_ptr<T> get_plan(size_t length)
+/* Returns the best of several timings of f() in seconds (at least three runs,
+   more until about a millisecond has been spent). */
+template<typename Func> double time_best(Func f)
   {
-#if POCKETFFT_CACHE_SIZE==0
-  return std::make_shared<T>(length);
-#else
-  constexpr size_t nmax=POCKETFFT_CACHE_SIZE;
-  static std::array<std::shared_ptr<T>, nmax> cache;
-  static std::array<size_t, nmax> last_access{{0}};
-  static size_t access_counter = 0;
-  static std::mutex mut;
-
-  auto find_in_cache = [&]() -> std::shared_ptr<T>
+  f(); // warm-up
+  double best=1e300, total=0.;
+  for (size_t i=0; (i<3) || ((total<1e-3) && (i<1000)); ++i)
     {
-    for (size_t i=0; i<nmax; ++i)
-      if (cache[i] && (cache[i]->length()==length))
-        {
-        // no need to update if this is already the most recent entry
-        if (last_access[i]!=access_counter)
-          {
-          last_access[i] = ++access_counter;
-          // Guard against overflow
-          if (access_counter == 0)
-            last_access.fill(0);
-          }
-        return cache[i];
-        }
-
-    return nullptr;
-    };
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    double t = std::chrono::duration<double>
+      (std::chrono::steady_clock::now()-t0).count();
+    best = std::min(best, t);
+    total += t;
+    }
+  return best;
+  }
 
+/* Times exec(data, scratch), where data is restored from `in` before every
+   run, so that values stay in a normal range. */
+template<typename T, typename Exec> double time_exec(const arr<T> &in,
+  size_t wsize, Exec exec)
   {
-  std::lock_guard<std::mutex> lock(mut);
-  auto p = find_in_cache();
-  if (p) return p;
+  arr<T> data(in.size()), buf(wsize);
+  return time_best([&]
+    {
+    std::copy_n(in.data(), in.size(), data.data());
+    exec(data.data(), buf.data());
+    });
   }
-  auto plan = std::make_shared<T>(length);
-  {
-  std::lock_guard<std::mutex> lock(mut);
-  auto p = find_in_cache();
-  if (p) return p;
-
-  size_t lru = 0;
-  for (size_t i=1; i<nmax; ++i)
-    if (last_access[i] < last_access[lru])
-      lru = i;
 
-  cache[lru] = plan;
-  last_access[lru] = ++access_counter;
-  }
-  return plan;
-#endif
+/* Factor orders tried in measure mode: the default order, its reverse and
+   the ascending and descending orders, for each grouping of the factors of 2
+   given in `groupings`. */
+inline std::vector<std::vector<size_t>> factor_orders(
+  const std::vector<std::vector<size_t>> &groupings)
+  {
+  std::vector<std::vector<size_t>> res;
+  auto add = [&res](const std::vector<size_t> &f)
+    {
+    if (std::find(res.begin(), res.end(), f)==res.end())
+      res.push_back(f);
+    };
+  for (const auto &g: groupings)
+    {
+    add(g);
+    add(std::vector<size_t>(g.rbegin(), g.rend()));
+    auto tmp(g);
+    std::sort(tmp.begin(), tmp.end());
+    add(tmp);
+    std::reverse(tmp.begin(), tmp.end());
+    add(tmp);
+    }
+  return res;
   }
 
-class arr_info
+/* Padded lengths tried for Bluestein's algorithm in measure mode, for a
+   convolution of at least nmin points: the default one, the next two larger
+   11-smooth lengths and the next power of two. */
+inline std::vector<size_t> bluestein_lengths(size_t nmin)
   {
-  protected:
-    shape_t shp;
-    stride_t str;
+  std::vector<size_t> res;
+  size_t n2 = util::good_size_cmplx(nmin);
+  for (size_t i=0; i<3; ++i, n2=util::good_size_cmplx(n2+1))
+    res.push_back(n2);
+  size_t p2=1;
+  while (p2<nmin) p2*=2;
+  if (std::find(res.begin(), res.end(), p2)==res.end())
+    res.push_back(p2);
+  return res;
+  }
 
-  public:
-    arr_info(const shape_t &shape_, const stride_t &stride_)
-      : shp(shape_), str(stride_) {}
-    size_t ndim() const { return shp.size(); }
-    size_t size() const { return util::prod(shp); }
-    const shape_t &shape() const { return shp; }
-    size_t shape(size_t i) const { return shp[i]; }
-    const stride_t &stride() const { return str; }
-    const ptrdiff_t &stride(size_t i) const { return str[i]; }
-  };
+//
+// flexible (FFTPACK/Bluestein) complex 1D transform
+//
 
-template<typename T> class cndarr: public arr_info
+template<typename T0> class pocketfft_c
   {
-  protected:
-    const char *d;
+  private:
+    std::unique_ptr<cfftp<T0>> packplan;
+    std::unique_ptr<fftblue<T0>> blueplan;
+    /* optional; used instead of packplan for single lines of scalar data,
+       if split_serial is set, or else only when running on several
+       threads */
+    std::unique_ptr<fftsplit<T0>> splitplan;
+    bool split_serial;
+    size_t len;
 
-  public:
-    cndarr(const void *data_, const shape_t &shape_, const stride_t &stride_)
-      : arr_info(shape_, stride_),
-        d(reinterpret_cast<const char *>(data_)) {}
-    const T &operator[](ptrdiff_t ofs) const
-      { return *reinterpret_cast<const T *>(d+ofs); }
-  };
+    /* adds a split plan for multithreaded execution if there is none */
+    void add_mt_split()
+      {
+      if (splitplan || !packplan) return;
+      size_t n1 = fftsplit<T0>::mt_split(len);
+      if (n1!=0)
+        splitplan=std::unique_ptr<fftsplit<T0>>(new fftsplit<T0>(len, n1));
+      split_serial = false;
+      }
 
-template<typename T> class ndarr: public cndarr<T>
-  {
   public:
-    ndarr(void *data_, const shape_t &shape_, const stride_t &stride_)
-      : cndarr<T>::cndarr(const_cast<const void *>(data_), shape_, stride_)
-      {}
-    T &operator[](ptrdiff_t ofs)
-      { return *reinterpret_cast<T *>(const_cast<char *>(cndarr<T>::d+ofs)); }
-  };
+    POCKETFFT_NOINLINE pocketfft_c(size_t length)
+      : split_serial(true), len(length)
+      {
+      if (length==0) throw std::runtime_error("zero-length FFT requested");
+      if (get_planning_mode()==planning_mode::measure)
+        { measure(); add_mt_split(); return; }
+      size_t tmp = (length<50) ? 0 : util::largest_prime_factor(length);
+      if (tmp*tmp <= length)
+        {
+        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
+        size_t n1 = fftsplit<T0>::split(length);
+        if (n1!=0)
+          splitplan=std::unique_ptr<fftsplit<T0>>(new fftsplit<T0>(length, n1));
+        add_mt_split();
+        return;
+        }
+      double comp1 = util::cost_guess(length, true);
+      double comp2 = 2*util::cost_guess(util::good_size_cmplx(2*length-1));
+      comp2*=1.5; /* fudge factor that appears to give good overall performance */
+      if (comp2<comp1) // use Bluestein
+        blueplan=std::unique_ptr<fftblue<T0>>(new fftblue<T0>(length));
+      else // FFTPACK, with Rader's algorithm for suitable prime factors
+        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
+      }
 
-template<size_t N> class multi_iter
-  {
   private:
-    shape_t pos;
-    const arr_info &iarr, &oarr;
-    ptrdiff_t p_ii, p_i[N], str_i, p_oi, p_o[N], str_o;
-    size_t idim, rem;
-
-    void advance_i()
+    /* Times the candidate algorithms and keeps the fastest. Candidates whose
+       estimated cost exceeds four times the cheapest estimate are skipped, so
+       that e.g. large prime lengths are never timed with the generic pass.
+       Factor orders are tried both with the generic pass and with Rader's
+       algorithm for the prime factors above 11. If FFTPACK wins, the
+       possible splits into two shorter transforms are timed as well. */
+    POCKETFFT_NOINLINE void measure()
       {
-      for (int i_=int(pos.size())-1; i_>=0; --i_)
+      size_t tmp = (len<50) ? 0 : util::largest_prime_factor(len);
+      double gcost = util::cost_guess(len), pcost = util::cost_guess(len, true);
+      std::vector<size_t> nblue;
+      if (tmp*tmp>len) nblue = bluestein_lengths(2*len-1);
+      double mincost = pcost;
+      for (auto n2: nblue)
+        mincost = std::min(mincost, 2*util::cost_guess(n2));
+      arr<cmplx<T0>> data(len);
+      for (size_t i=0; i<len; ++i)
+        data[i].Set(T0(1)/T0(i+1), T0(1)/T0(i+2));
+      bool use_rader = util::rader_possible(util::largest_prime_factor(len));
+      double best=1e300;
+      if (pcost<=4*mincost)
+        for (const auto &f: factor_orders({cfftp<T0>::factorize(len, 32),
+                                          cfftp<T0>::factorize(len, 16),
+                                          cfftp<T0>::factorize(len, 8),
+                                          cfftp<T0>::factorize(len, 4)}))
+          for (int rader=use_rader ? 1 : 0; rader>=0; --rader)
+            {
+            if ((!rader) && (gcost>4*mincost)) continue;
+            std::unique_ptr<cfftp<T0>> plan(new cfftp<T0>(len, f, rader!=0));
+            double t = time_exec(data, plan->workspace_size(),
+              [&plan](cmplx<T0> *c, cmplx<T0> *buf)
+              { plan->exec(c, T0(1), true, buf); });
+            if (t<best) { best=t; packplan=std::move(plan); }
+            }
+      for (auto n2: nblue)
         {
-        auto i = size_t(i_);
-        if (i==idim) continue;
-        p_ii += iarr.stride(i);
-        p_oi += oarr.stride(i);
-        if (++pos[i] < iarr.shape(i))
-          return;
-        pos[i] = 0;
-        p_ii -= ptrdiff_t(iarr.shape(i))*iarr.stride(i);
-        p_oi -= ptrdiff_t(oarr.shape(i))*oarr.stride(i);
+        if (2*util::cost_guess(n2)>4*mincost) continue;
+        std::unique_ptr<fftblue<T0>> plan(new fftblue<T0>(len, n2));
+        double t = time_exec(data, plan->workspace_size(),
+          [&plan](cmplx<T0> *c, cmplx<T0> *buf)
+          { plan->exec(c, T0(1), true, buf); });
+        if (t<best) { best=t; blueplan=std::move(plan); packplan.reset(); }
+        }
+      if (!packplan) return;
+      for (auto n1: fftsplit<T0>::splits(len))
+        {
+        std::unique_ptr<fftsplit<T0>> plan(new fftsplit<T0>(len, n1));
+        double t = time_exec(data, plan->workspace_size(),
+          [&plan](cmplx<T0> *c, cmplx<T0> *buf)
+          { plan->exec(c, T0(1), true, buf); });
+        if (t<best) { best=t; splitplan=std::move(plan); }
         }
       }
 
   public:
-    multi_iter(const arr_info &iarr_, const arr_info &oarr_, size_t idim_)
-      : pos(iarr_.ndim(), 0), iarr(iarr_), oarr(oarr_), p_ii(0),
-        str_i(iarr.stride(idim_)), p_oi(0), str_o(oarr.stride(idim_)),
-        idim(idim_), rem(iarr.size()/iarr.shape(idim))
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE pocketfft_c(plan_reader &rd)
+      : split_serial(true), len(rd.get_size())
       {
-      auto nshares = threading::num_threads();
-      if (nshares==1) return;
-      if (nshares==0) throw std::runtime_error("can't run with zero threads");
-      auto myshare = threading::thread_id();
-      if (myshare>=nshares) throw std::runtime_error("impossible share requested");
-      size_t nbase = rem/nshares;
-      size_t additional = rem%nshares;
-      size_t lo = myshare*nbase + ((myshare<additional) ? myshare : additional);
-      size_t hi = lo+nbase+(myshare<additional);
-      size_t todo = hi-lo;
+      /* 0: FFTPACK, 1: Bluestein, 2: FFTPACK followed by a split plan */
+      auto kind = rd.get<std::uint8_t>();
+      if (kind>2)
+        throw std::runtime_error("corrupt plan data");
+      if (kind==1)
+        blueplan=std::unique_ptr<fftblue<T0>>(new fftblue<T0>(rd));
+      else
+        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(rd));
+      if (kind==2)
+        splitplan=std::unique_ptr<fftsplit<T0>>(new fftsplit<T0>(rd));
+      add_mt_split();
+      if (((packplan ? packplan->len() : blueplan->length())!=len)
+        || (splitplan && (splitplan->length()!=len)))
+        throw std::runtime_error("corrupt plan data");
+      }
 
-      size_t chunk = rem;
-      for (size_t i=0; i<pos.size(); ++i)
-        {
-        if (i==idim) continue;
-        chunk /= iarr.shape(i);
-        size_t n_advance = lo/chunk;
-        pos[i] += n_advance;
-        p_ii += ptrdiff_t(n_advance)*iarr.stride(i);
-        p_oi += ptrdiff_t(n_advance)*oarr.stride(i);
-        lo -= n_advance*chunk;
-        }
-      rem = todo;
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(len);
+      bool split = splitplan && split_serial;
+      wr.put(std::uint8_t(blueplan ? 1 : (split ? 2 : 0)));
+      packplan ? packplan->serialize(wr) : blueplan->serialize(wr);
+      if (split) splitplan->serialize(wr);
       }
-    void advance(size_t n)
+
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
       {
-      if (rem<n) throw std::runtime_error("underrun");
-      for (size_t i=0; i<n; ++i)
+      if (!packplan) return blueplan->workspace_size();
+      return splitplan ? std::max(packplan->workspace_size(),
+                                  splitplan->workspace_size())
+                       : packplan->workspace_size();
+      }
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      {
+      return (packplan ? sizeof(*packplan) + packplan->memory_size()
+                       : sizeof(*blueplan) + blueplan->memory_size())
+        + (splitplan ? sizeof(*splitplan) + splitplan->memory_size() : 0);
+      }
+
+    /* Data already vectorized across several lines (T != T0) does not
+       profit from the split plan, so it always uses packplan. Only the split
+       plan can use several threads (nthreads==0 means all hardware
+       threads). */
+    template<typename T> POCKETFFT_NOINLINE void exec(cmplx<T> c[], T0 fct, bool fwd,
+      cmplx<T> *buf, size_t nthreads=1) const
+      {
+      if (splitplan && std::is_same<T, T0>::value
+        && (split_serial || (nthreads!=1)))
+        splitplan->exec(c,fct,fwd,buf,nthreads);
+      else
+        packplan ? packplan->exec(c,fct,fwd,buf) : blueplan->exec(c,fct,fwd,buf);
+      }
+    /* out-of-place variant; in may be equal to out. Only packplan reads
+       `in` directly, the other plans work on a copy in `out`. */
+    template<typename T> POCKETFFT_NOINLINE void exec(const cmplx<T> in[],
+      cmplx<T> out[], T0 fct, bool fwd, cmplx<T> *buf, size_t nthreads=1) const
+      {
+      if (packplan && !(splitplan && std::is_same<T, T0>::value
+        && (split_serial || (nthreads!=1))))
+        packplan->exec(in,out,fct,fwd,buf);
+      else
         {
-        p_i[i] = p_ii;
-        p_o[i] = p_oi;
-        advance_i();
+        if (in!=out) std::copy_n(in, len, out);
+        exec(out, fct, fwd, buf, nthreads);
         }
-      rem -= n;
       }
-    ptrdiff_t iofs(size_t i) const { return p_i[0] + ptrdiff_t(i)*str_i; }
-    ptrdiff_t iofs(size_t j, size_t i) const { return p_i[j] + ptrdiff_t(i)*str_i; }
-    ptrdiff_t oofs(size_t i) const { return p_o[0] + ptrdiff_t(i)*str_o; }
-    ptrdiff_t oofs(size_t j, size_t i) const { return p_o[j] + ptrdiff_t(i)*str_o; }
-    size_t length_in() const { return iarr.shape(idim); }
-    size_t length_out() const { return oarr.shape(idim); }
-    ptrdiff_t stride_in() const { return str_i; }
-    ptrdiff_t stride_out() const { return str_o; }
-    size_t remaining() const { return rem; }
+    template<typename T> void exec(cmplx<T> c[], T0 fct, bool fwd) const
+      {
+      arr<cmplx<T>> buf(workspace_size());
+      exec(c, fct, fwd, buf.data());
+      }
+
+    size_t length() const { return len; }
   };
 
-class simple_iter
+/* Real FFT of even length n via a complex FFT of length n/2, followed by
+   (or, backward, preceded by) an O(n) twiddle step; see hc_from_half().
+   Profits from the complex codelets and, through pocketfft_c, from the
+   four-step split and its multithreading. */
+template<typename T0> class rfft_half
   {
   private:
-    shape_t pos;
-    const arr_info &arr;
-    ptrdiff_t p;
-    size_t rem;
+    size_t n;
+    pocketfft_c<T0> plan;
+    arr<cmplx<T0>> mem;
+    const cmplx<T0> *tw; // exp(-2*pi*i*k/n), k<=n/4
+    std::shared_ptr<const void> ext; // owner of tw, if not in mem
 
   public:
-    simple_iter(const arr_info &arr_)
-      : pos(arr_.ndim(), 0), arr(arr_), p(0), rem(arr_.size()) {}
-    void advance()
+    POCKETFFT_NOINLINE rfft_half(size_t length)
+      : n(length), plan(length/2), mem(length/4+1), tw(mem.data())
       {
-      --rem;
-      for (int i_=int(pos.size())-1; i_>=0; --i_)
+      if ((n&1)!=0) throw std::invalid_argument("odd length");
+      sincos_2pibyn<T0> roots(n);
+      for (size_t k=0; k<mem.size(); ++k)
+        mem[k] = conj(roots[k]);
+      }
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE rfft_half(plan_reader &rd)
+      : n(2*rd.get_size()), plan(rd)
+      {
+      if ((n==0) || (plan.length()!=n/2))
+        throw std::runtime_error("corrupt plan data");
+      tw = rd.get_array<cmplx<T0>>(n/4+1);
+      ext = rd.keepalive();
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(n/2);
+      plan.serialize(wr);
+      wr.put_array(tw, n/4+1);
+      }
+
+    size_t length() const { return n; }
+
+    /* scratch space needed by exec(), in units of T */
+    size_t workspace_size() const { return n+2*plan.workspace_size(); }
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      { return mem.size()*sizeof(cmplx<T0>) + plan.memory_size(); }
+
+    template<typename T> void exec(T c[], T0 fct, bool fwd, T *buf,
+      size_t nthreads=1) const
+      {
+      size_t nh = n/2;
+      auto z = reinterpret_cast<cmplx<T> *>(buf);
+      if (fwd)
         {
-        auto i = size_t(i_);
-        p += arr.stride(i);
-        if (++pos[i] < arr.shape(i))
-          return;
-        pos[i] = 0;
-        p -= ptrdiff_t(arr.shape(i))*arr.stride(i);
+        for (size_t m=0; m<nh; ++m)
+          z[m].Set(c[2*m], c[2*m+1]);
+        plan.exec(z, fct, true, z+nh, nthreads);
+        hc_from_half(z, c, tw, n);
+        }
+      else
+        {
+        half_from_hc(c, z, tw, n);
+        plan.exec(z, fct, false, z+nh, nthreads);
+        for (size_t m=0; m<nh; ++m)
+          { c[2*m] = z[m].r; c[2*m+1] = z[m].i; }
         }
       }
-    ptrdiff_t ofs() const { return p; }
-    size_t remaining() const { return rem; }
   };
 
-class rev_iter
+//
+// flexible (FFTPACK/Bluestein) real-valued 1D transform
+//
+
+template<typename T0> class pocketfft_r
   {
   private:
-    shape_t pos;
-    const arr_info &arr;
-    std::vector<char> rev_axis;
-    std::vector<char> rev_jump;
-    size_t last_axis, last_size;
-    shape_t shp;
-    ptrdiff_t p, rp;
-    size_t rem;
+    std::unique_ptr<rfftp<T0>> packplan;
+    std::unique_ptr<fftblue_r<T0>> blueplan;
+    /* optional; used instead of packplan and blueplan if half_serial is
+       set, or else only when running on several threads */
+    std::unique_ptr<rfft_half<T0>> halfplan;
+    /* optional; complex plan of the same length used by exec_pair() */
+    std::unique_ptr<pocketfft_c<T0>> pairplan;
+    bool half_serial;
+    size_t len;
 
-  public:
-    rev_iter(const arr_info &arr_, const shape_t &axes)
-      : pos(arr_.ndim(), 0), arr(arr_), rev_axis(arr_.ndim(), 0),
-        rev_jump(arr_.ndim(), 1), p(0), rp(0)
+    /* adds a half-length plan for multithreaded execution if there is none
+       and its complex transform can run on several threads */
+    void add_mt_half()
       {
-      for (auto ax: axes)
-        rev_axis[ax]=1;
-      last_axis = axes.back();
-      last_size = arr.shape(last_axis)/2 + 1;
-      shp = arr.shape();
-      shp[last_axis] = last_size;
-      rem=1;
-      for (auto i: shp)
-        rem *= i;
+      if (halfplan || !packplan || (len&1)) return;
+      if (fftsplit<T0>::mt_split(len/2)!=0)
+        halfplan=std::unique_ptr<rfft_half<T0>>(new rfft_half<T0>(len));
+      half_serial = false;
       }
-    void advance()
+
+  public:
+    POCKETFFT_NOINLINE pocketfft_r(size_t length)
+      : half_serial(true), len(length)
       {
-      --rem;
-      for (int i_=int(pos.size())-1; i_>=0; --i_)
+      if (length==0) throw std::runtime_error("zero-length FFT requested");
+      if (get_planning_mode()==planning_mode::measure)
+        { measure(); add_mt_half(); return; }
+      size_t tmp = (length<50) ? 0 : util::largest_prime_factor(length);
+      if (tmp*tmp <= length)
         {
-        auto i = size_t(i_);
-        p += arr.stride(i);
-        if (!rev_axis[i])
-          rp += arr.stride(i);
+        /* the half-length complex transform beats rfftp once it is
+           vectorized via the four-step split */
+        if (((length&1)==0) && (fftsplit<T0>::split(length/2)!=0))
+          halfplan=std::unique_ptr<rfft_half<T0>>(new rfft_half<T0>(length));
         else
+          packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
+        add_mt_half();
+        return;
+        }
+      double comp1 = 0.5*util::cost_guess(length);
+      double comp2 = 2*util::cost_guess(util::good_size_cmplx(
+        fftblue_r<T0>::min_conv_length(length)));
+      comp2*=1.5; /* fudge factor that appears to give good overall performance */
+      if (comp2<comp1) // use Bluestein
+        blueplan=std::unique_ptr<fftblue_r<T0>>(new fftblue_r<T0>(length));
+      else
+        packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
+      add_mt_half();
+      }
+
+  private:
+    /* see pocketfft_c::measure(); for even lengths, the half-length complex
+       transform is timed as well */
+    POCKETFFT_NOINLINE void measure()
+      {
+      size_t tmp = (len<50) ? 0 : util::largest_prime_factor(len);
+      double pcost = 0.5*util::cost_guess(len);
+      std::vector<size_t> nblue;
+      if (tmp*tmp>len)
+        nblue = bluestein_lengths(fftblue_r<T0>::min_conv_length(len));
+      double mincost = pcost;
+      for (auto n2: nblue)
+        mincost = std::min(mincost, 2*util::cost_guess(n2));
+      arr<T0> data(len);
+      for (size_t i=0; i<len; ++i)
+        data[i] = T0(1)/T0(i+1);
+      double best=1e300;
+      if (pcost<=4*mincost)
+        for (const auto &f: factor_orders({rfftp<T0>::factorize(len, 8),
+                                          rfftp<T0>::factorize(len, 4),
+                                          rfftp<T0>::factorize(len, 2)}))
           {
-          rp -= arr.stride(i);
-          if (rev_jump[i])
-            {
-            rp += ptrdiff_t(arr.shape(i))*arr.stride(i);
-            rev_jump[i] = 0;
-            }
+          if (!rfftp<T0>::evens_first(f)) continue;
+          std::unique_ptr<rfftp<T0>> plan(new rfftp<T0>(len, f));
+          double t = time_exec(data, plan->workspace_size(),
+            [&plan](T0 *c, T0 *buf) { plan->exec(c, T0(1), true, buf); });
+          if (t<best) { best=t; packplan=std::move(plan); }
           }
-        if (++pos[i] < shp[i])
-          return;
-        pos[i] = 0;
-        p -= ptrdiff_t(shp[i])*arr.stride(i);
-        if (rev_axis[i])
+      for (auto n2: nblue)
+        {
+        if (2*util::cost_guess(n2)>4*mincost) continue;
+        std::unique_ptr<fftblue_r<T0>> plan(new fftblue_r<T0>(len, n2));
+        double t = time_exec(data, plan->workspace_size(),
+          [&plan](T0 *c, T0 *buf) { plan->exec(c, T0(1), true, buf); });
+        if (t<best) { best=t; blueplan=std::move(plan); packplan.reset(); }
+        }
+      if ((len&1)==0)
+        {
+        std::unique_ptr<rfft_half<T0>> plan(new rfft_half<T0>(len));
+        double t = time_exec(data, plan->workspace_size(),
+          [&plan](T0 *c, T0 *buf) { plan->exec(c, T0(1), true, buf); });
+        if (t<best)
+          { best=t; halfplan=std::move(plan); packplan.reset(); blueplan.reset(); }
+        }
+      /* Batches of scalar lines can also be transformed two at a time with a
+         complex FFT; the cost model can't tell when this pays off, so it is
+         only ever chosen here. */
+      if (len<2) return;
+      std::unique_ptr<pocketfft_c<T0>> plan(new pocketfft_c<T0>(len));
+      arr<cmplx<T0>> cdata(len);
+      for (size_t i=0; i<len; ++i)
+        cdata[i].Set(T0(1)/T0(i+1), T0(1)/T0(i+2));
+      pairplan = std::move(plan);
+      double t = time_exec(cdata, pairplan->workspace_size(),
+        [this](cmplx<T0> *c, cmplx<T0> *buf)
+        { exec_pair(c, T0(1), true, buf); });
+      if (t>=2*best) pairplan.reset();
+      }
+
+  public:
+    /* reconstructs a plan stored by serialize() without recomputing it */
+    POCKETFFT_NOINLINE pocketfft_r(plan_reader &rd)
+      : half_serial(true), len(rd.get_size())
+      {
+      /* bit 0: Bluestein instead of FFTPACK, bit 1: a pair plan follows,
+         bit 2: half-length complex plan instead of FFTPACK */
+      auto kind = rd.get<std::uint8_t>();
+      if ((kind>7) || ((kind&5)==5))
+        throw std::runtime_error("corrupt plan data");
+      if (kind&4)
+        halfplan=std::unique_ptr<rfft_half<T0>>(new rfft_half<T0>(rd));
+      else if (kind&1)
+        blueplan=std::unique_ptr<fftblue_r<T0>>(new fftblue_r<T0>(rd));
+      else
+        packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(rd));
+      if (kind&2)
+        pairplan=std::unique_ptr<pocketfft_c<T0>>(new pocketfft_c<T0>(rd));
+      if ((packplan ? packplan->len() : blueplan ? blueplan->length()
+                                                 : halfplan->length())!=len)
+        throw std::runtime_error("corrupt plan data");
+      add_mt_half();
+      if (pairplan && (pairplan->length()!=len))
+        throw std::runtime_error("corrupt plan data");
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(len);
+      bool half = halfplan && half_serial;
+      wr.put(std::uint8_t((blueplan ? 1 : 0) | (pairplan ? 2 : 0)
+        | (half ? 4 : 0)));
+      if (half)
+        halfplan->serialize(wr);
+      else
+        packplan ? packplan->serialize(wr) : blueplan->serialize(wr);
+      if (pairplan) pairplan->serialize(wr);
+      }
+
+    /* number of elements of scratch space needed by exec(); if paired() is
+       true, this also covers a line pair and the scratch space of
+       exec_pair(), as len complex numbers followed by pair_workspace_size()
+       more */
+    size_t workspace_size() const
+      {
+      size_t res = packplan ? packplan->workspace_size()
+                 : blueplan ? blueplan->workspace_size() : 0;
+      if (halfplan) res = std::max(res, halfplan->workspace_size());
+      return pairplan ? std::max(res, len+2*pair_workspace_size()) : res;
+      }
+    /* approximate heap memory held by the plan, in bytes */
+    size_t memory_size() const
+      {
+      size_t res = packplan ? sizeof(*packplan) + packplan->memory_size()
+                 : blueplan ? sizeof(*blueplan) + blueplan->memory_size() : 0;
+      if (halfplan) res += sizeof(*halfplan) + halfplan->memory_size();
+      if (pairplan) res += sizeof(*pairplan) + pairplan->memory_size();
+      return res;
+      }
+
+    /* true if batches of scalar lines should be transformed in pairs */
+    bool paired() const { return bool(pairplan); }
+    /* number of complex elements of scratch space needed by exec_pair() */
+    size_t pair_workspace_size() const
+      { return pairplan ? pairplan->workspace_size() : 0; }
+
+    /* Transforms two real arrays a and b at once with one complex FFT, using
+       the symmetries of the spectra of real data. The pair is stored in c in
+       a packed layout: the real data as c[i]=(a[i],b[i]), the spectra as
+       c[0]=(A[0],B[0]), c[k]=A[k] and c[len-k]=B[k] for 0<k<len-k, and
+       c[len/2]=(A[len/2],B[len/2]) if len is even. Only available if
+       paired() is true. */
+    template<typename T> POCKETFFT_NOINLINE void exec_pair(cmplx<T> c[],
+      T0 fct, bool r2hc, cmplx<T> *buf, size_t nthreads=1) const
+      {
+      if (r2hc)
+        {
+        pairplan->exec(c, fct, true, buf, nthreads);
+        for (size_t k=1, kc=len-1; k<kc; ++k, --kc)
           {
-          rp -= ptrdiff_t(arr.shape(i)-shp[i])*arr.stride(i);
-          rev_jump[i] = 1;
+          auto a=c[k], b=conj(c[kc]);
+          c[k] = (a+b)*T0(0.5);
+          c[kc] = cmplx<T>((a.i-b.i)*T0(0.5), (b.r-a.r)*T0(0.5));
           }
-        else
-          rp -= ptrdiff_t(shp[i])*arr.stride(i);
+        }
+      else
+        {
+        for (size_t k=1, kc=len-1; k<kc; ++k, --kc)
+          {
+          auto a=c[k], b=c[kc];
+          c[k] = cmplx<T>(a.r-b.i, a.i+b.r);
+          c[kc] = cmplx<T>(a.r+b.i, b.r-a.i);
+          }
+        pairplan->exec(c, fct, false, buf, nthreads);
         }
       }
-    ptrdiff_t ofs() const { return p; }
-    ptrdiff_t rev_ofs() const { return rp; }
-    size_t remaining() const { return rem; }
-  };
 
-template<typename T> struct VTYPE {};
-template <typename T> using vtype_t = typename VTYPE<T>::type;
+    /* Only the half-length plan can use several threads (nthreads==0 means
+       all hardware threads); rfftp and fftblue_r run on a single one. */
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool fwd,
+      T *buf, size_t nthreads=1) const
+      {
+      if (halfplan && (half_serial || (nthreads!=1)))
+        halfplan->exec(c,fct,fwd,buf,nthreads);
+      else
+        packplan ? packplan->exec(c,fct,fwd,buf) : blueplan->exec(c,fct,fwd,buf);
+      }
+    /* out-of-place variant; in may be equal to out. Only rfftp reads `in`
+       directly, the other plans work on a copy in `out`. */
+    template<typename T> POCKETFFT_NOINLINE void exec(const T in[], T out[],
+      T0 fct, bool fwd, T *buf, size_t nthreads=1) const
+      {
+      if (packplan && !(halfplan && (half_serial || (nthreads!=1))))
+        packplan->exec(in,out,fct,fwd,buf);
+      else
+        {
+        if (in!=out) std::copy_n(in, len, out);
+        exec(out, fct, fwd, buf, nthreads);
+        }
+      }
+    template<typename T> void exec(T c[], T0 fct, bool fwd) const
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, fwd, buf.data());
+      }
 
-#ifndef POCKETFFT_NO_VECTORS
-template<> struct VTYPE<float>
-  {
-  using type = float __attribute__ ((vector_size (VLEN<float>::val*sizeof(float))));
+    size_t length() const { return len; }
   };
-template<> struct VTYPE<double>
+
+
+//
+// sine/cosine transforms
+//
+
+/* DCT/DST of types II and III. For even N, the algorithm of Makhoul (IEEE
+   Trans. ASSP 28, 27 (1980)) is used: the input is reordered to v[j]=c[2j], v[N-1-j]=c[2j+1] and
+   transformed with a complex FFT of length N/2 of the packed pairs
+   (v[2m],v[2m+1]); the post-processing step of the real FFT is fused with
+   the twiddling by exp(-i*pi*k/(2N)). Odd lengths use the FFTPACK algorithm
+   on top of a real FFT of length N. */
+template<typename T0> class T_dcst23
   {
-  using type = double __attribute__ ((vector_size (VLEN<double>::val*sizeof(double))));
+  private:
+    size_t N;
+    std::unique_ptr<pocketfft_c<T0>> fft;
+    std::unique_ptr<pocketfft_r<T0>> rfft;
+    arr<cmplx<T0>> twmem;
+    /* even N: twiddle[2k]=exp(-2*pi*i*k/N), twiddle[2k+1]=exp(-i*pi*k/(2N))
+       for k<=N/4; odd N: twiddle[k]=exp(-i*pi*k/(2N)) for k<=N/2 */
+    const cmplx<T0> *twiddle;
+    std::shared_ptr<const void> ext; // owner of twiddle, if not in twmem
+
+    size_t twsize() const { return (N&1) ? N/2+1 : 2*(N/4+1); }
+
+    template<typename T> void exec_even(T c[], T0 fct, int type, T *buf,
+      size_t nthreads) const
+      {
+      constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L),
+                   sqrthalf=T0(0.707106781186547524400844362104849L);
+      size_t n2=N/2;
+      auto z = reinterpret_cast<cmplx<T> *>(buf);
+      if (type==2)
+        {
+        /* the packed pairs are v[0..N-1] in order */
+        for (size_t j=0; j<n2; ++j)
+          { buf[j] = c[2*j]; buf[N-1-j] = c[2*j+1]; }
+        fft->exec(z, fct, true, z+n2, nthreads);
+        c[0] = 2*(z[0].r+z[0].i);
+        c[n2] = sqrt2*(z[0].r-z[0].i);
+        for (size_t k=1, kc=n2-1; k<=kc; ++k, --kc)
+          {
+          auto a = z[k], b = conj(z[kc]);
+          auto e = a+b, d = a-b;
+          auto o = cmplx<T>(d.i, -d.r)*twiddle[2*k]; // w_k*(a-b)/i
+          auto t = (e+o)*twiddle[2*k+1];
+          c[k] = t.r; c[N-k] = -t.i;
+          if (k!=kc)
+            {
+            /* exp(-i*pi*kc/(2N)) = exp(-i*pi/4)*conj(twiddle[2k+1]) */
+            auto q = (e-o)*twiddle[2*k+1];
+            c[kc] = sqrthalf*(q.r-q.i); c[N-kc] = sqrthalf*(q.r+q.i);
+            }
+          }
+        }
+      else
+        {
+        T h0 = c[0], hn2 = sqrt2*c[n2];
+        z[0].Set(h0+hn2, h0-hn2);
+        for (size_t k=1, kc=n2-1; k<=kc; ++k, --kc)
+          {
+          /* h_k and conj(h_kc) of the Hermitian input of v */
+          auto hk = cmplx<T>(c[k], -c[N-k]).template special_mul<true>
+            (twiddle[2*k+1]);
+          auto p = cmplx<T>(c[kc], -c[N-kc])*twiddle[2*k+1];
+          auto hkc = cmplx<T>(sqrthalf*(p.r-p.i), -sqrthalf*(p.r+p.i));
+          auto e = hk+hkc,
+               d = (hk-hkc).template special_mul<true>(twiddle[2*k]);
+          z[k].Set(e.r-d.i, e.i+d.r); // e + i*d
+          if (k!=kc)
+            z[kc].Set(e.r+d.i, d.r-e.i); // conj(e) + i*conj(d)
+          }
+        fft->exec(z, fct, false, z+n2, nthreads);
+        for (size_t j=0; j<n2; ++j)
+          { c[2*j] = buf[j]; c[2*j+1] = buf[N-1-j]; }
+        }
+      }
+
+  public:
+    POCKETFFT_NOINLINE T_dcst23(size_t length)
+      : N(length),
+        fft((N&1) ? nullptr : new pocketfft_c<T0>(N/2)),
+        rfft((N&1) ? new pocketfft_r<T0>(N) : nullptr),
+        twmem(twsize()), twiddle(twmem.data())
+      {
+      sincos_2pibyn<T0> tw(4*N);
+      if (N&1)
+        for (size_t k=0; k<=N/2; ++k)
+          twmem[k] = conj(tw[k]);
+      else
+        for (size_t k=0; k<=N/4; ++k)
+          {
+          twmem[2*k] = conj(tw[4*k]);
+          twmem[2*k+1] = conj(tw[k]);
+          }
+      }
+    POCKETFFT_NOINLINE T_dcst23(plan_reader &rd)
+      : N(rd.get_size()), twiddle(nullptr)
+      {
+      if (N==0) throw std::runtime_error("corrupt plan data");
+      if (N&1)
+        {
+        rfft.reset(new pocketfft_r<T0>(rd));
+        if (rfft->length()!=N) throw std::runtime_error("corrupt plan data");
+        }
+      else
+        {
+        fft.reset(new pocketfft_c<T0>(rd));
+        if (fft->length()!=N/2) throw std::runtime_error("corrupt plan data");
+        }
+      twiddle = rd.get_array<cmplx<T0>>(twsize());
+      ext = rd.keepalive();
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(N);
+      (N&1) ? rfft->serialize(wr) : fft->serialize(wr);
+      wr.put_array(twiddle, twsize());
+      }
+
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
+      { return (N&1) ? rfft->workspace_size() : N+2*fft->workspace_size(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
+      int type, bool cosine, T *buf, size_t nthreads=1) const
+      {
+      constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
+      size_t NS2 = (N+1)/2;
+      if (type==2)
+        {
+        if (!cosine)
+          for (size_t k=1; k<N; k+=2)
+            c[k] = -c[k];
+        if ((N&1)==0)
+          exec_even(c, fct, type, buf, nthreads);
+        else
+          {
+          c[0] *= 2;
+          for (size_t k=1; k<N-1; k+=2)
+            MPINPLACE(c[k+1], c[k]);
+          rfft->exec(c, fct, false, buf, nthreads);
+          for (size_t k=1, kc=N-1; k<NS2; ++k, --kc)
+            {
+            T0 wr=twiddle[k].r, wi=-twiddle[k].i;
+            T t1 = wr*c[kc]+wi*c[k];
+            T t2 = wr*c[k]-wi*c[kc];
+            c[k] = T0(0.5)*(t1+t2); c[kc]=T0(0.5)*(t1-t2);
+            }
+          }
+        if (!cosine)
+          for (size_t k=0, kc=N-1; k<kc; ++k, --kc)
+            std::swap(c[k], c[kc]);
+        if (ortho) c[0]*=sqrt2*T0(0.5);
+        }
+      else
+        {
+        if (ortho) c[0]*=sqrt2;
+        if (!cosine)
+          for (size_t k=0, kc=N-1; k<NS2; ++k, --kc)
+            std::swap(c[k], c[kc]);
+        if ((N&1)==0)
+          exec_even(c, fct, type, buf, nthreads);
+        else
+          {
+          for (size_t k=1, kc=N-1; k<NS2; ++k, --kc)
+            {
+            T0 wr=twiddle[k].r, wi=-twiddle[k].i;
+            T t1=c[k]+c[kc], t2=c[k]-c[kc];
+            c[k] = wr*t2+wi*t1;
+            c[kc]= wr*t1-wi*t2;
+            }
+          rfft->exec(c, fct, true, buf, nthreads);
+          for (size_t k=1; k<N-1; k+=2)
+            MPINPLACE(c[k], c[k+1]);
+          }
+        if (!cosine)
+          for (size_t k=1; k<N; k+=2)
+            c[k] = -c[k];
+        }
+      }
+    template<typename T> void exec(T c[], T0 fct, bool ortho, int type,
+      bool cosine) const
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, ortho, type, cosine, buf.data());
+      }
+
+    size_t length() const { return N; }
+    size_t memory_size() const
+      {
+      return twmem.size()*sizeof(cmplx<T0>)
+        + (fft ? sizeof(*fft) + fft->memory_size() : 0)
+        + (rfft ? sizeof(*rfft) + rfft->memory_size() : 0);
+      }
   };
-template<> struct VTYPE<long double>
+
+/* For odd n=length-1, DCT-I is computed as a real FFT of length 2n of the
+   symmetrically extended input. For even n, the outputs with even index
+   form a DCT-I of length n/2+1 of x[j]+x[n-j], and those with odd index a
+   DCT-III of length n/2 of x[j]-x[n-j]; applied recursively, this reduces
+   the cost to about that of one real FFT of length n. */
+template<typename T0> class T_dct1
   {
-  using type = long double __attribute__ ((vector_size (VLEN<long double>::val*sizeof(long double))));
+  private:
+    std::unique_ptr<pocketfft_r<T0>> fftplan;
+    std::unique_ptr<T_dct1> evenplan;
+    std::unique_ptr<T_dcst23<T0>> oddplan;
+
+  public:
+    POCKETFFT_NOINLINE T_dct1(size_t length)
+      {
+      if ((length>=5) && ((length&1)==1))
+        {
+        evenplan.reset(new T_dct1(length/2+1));
+        oddplan.reset(new T_dcst23<T0>(length/2));
+        }
+      else
+        fftplan.reset(new pocketfft_r<T0>(2*(length-1)));
+      }
+    POCKETFFT_NOINLINE T_dct1(plan_reader &rd)
+      {
+      if (rd.get<std::uint8_t>()!=0)
+        {
+        evenplan.reset(new T_dct1(rd));
+        oddplan.reset(new T_dcst23<T0>(rd));
+        if (oddplan->length()+1!=evenplan->length())
+          throw std::runtime_error("corrupt plan data");
+        }
+      else
+        {
+        fftplan.reset(new pocketfft_r<T0>(rd));
+        if ((fftplan->length()&1)!=0)
+          throw std::runtime_error("corrupt plan data");
+        }
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put(std::uint8_t(fftplan ? 0 : 1));
+      if (fftplan)
+        fftplan->serialize(wr);
+      else
+        { evenplan->serialize(wr); oddplan->serialize(wr); }
+      }
+
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
+      {
+      return fftplan ? fftplan->length()+fftplan->workspace_size()
+        : length()+std::max(evenplan->workspace_size(),
+                            oddplan->workspace_size());
+      }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
+      int type, bool cosine, T *buf, size_t nthreads=1) const
+      {
+      constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
+      size_t n=length()-1;
+      if (ortho)
+        { c[0]*=sqrt2; c[n]*=sqrt2; }
+      if (fftplan)
+        {
+        size_t N=fftplan->length();
+        auto tmp = buf;
+        tmp[0] = c[0];
+        for (size_t i=1; i<=n; ++i)
+          tmp[i] = tmp[N-i] = c[i];
+        fftplan->exec(tmp, fct, true, buf+N, nthreads);
+        c[0] = tmp[0];
+        for (size_t i=1; i<=n; ++i)
+          c[i] = tmp[2*i-1];
+        }
+      else
+        {
+        size_t m=n/2;
+        auto u=buf, w=buf+m+1;
+        u[0] = c[0]+c[n]; w[0] = c[0]-c[n];
+        for (size_t j=1; j<m; ++j)
+          { u[j] = c[j]+c[n-j]; w[j] = c[j]-c[n-j]; }
+        u[m] = 2*c[m];
+        evenplan->exec(u, fct, false, type, cosine, buf+n+1, nthreads);
+        oddplan->exec(w, fct, false, 3, true, buf+n+1, nthreads);
+        for (size_t j=0; j<m; ++j)
+          { c[2*j] = u[j]; c[2*j+1] = w[j]; }
+        c[n] = u[m];
+        }
+      if (ortho)
+        { c[0]*=sqrt2*T0(0.5); c[n]*=sqrt2*T0(0.5); }
+      }
+    template<typename T> void exec(T c[], T0 fct, bool ortho, int type,
+      bool cosine) const
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, ortho, type, cosine, buf.data());
+      }
+
+    size_t length() const
+      { return fftplan ? fftplan->length()/2+1 : 2*evenplan->length()-1; }
+    size_t memory_size() const
+      {
+      return fftplan ? sizeof(*fftplan) + fftplan->memory_size()
+        : sizeof(*evenplan) + evenplan->memory_size()
+          + sizeof(*oddplan) + oddplan->memory_size();
+      }
   };
-#endif
 
-template<typename T> arr<char> alloc_tmp(const shape_t &shape,
-  size_t axsize, size_t elemsize)
-  {
-  auto othersize = util::prod(shape)/axsize;
-  auto tmpsize = axsize*((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
-  return arr<char>(tmpsize*elemsize);
-  }
-template<typename T> arr<char> alloc_tmp(const shape_t &shape,
-  const shape_t &axes, size_t elemsize)
+/* As for T_dct1: for odd n=length+1, DST-I is computed as a real FFT of
+   length 2n. For even n, the outputs with odd index form a DST-I of length
+   n/2-1 of x[j]-x[n-2-j], and those with even index a DST-III of length n/2
+   of x[j]+x[n-2-j] (with 2*x[n/2-1] as the last input). */
+template<typename T0> class T_dst1
   {
-  size_t fullsize=util::prod(shape);
-  size_t tmpsize=0;
-  for (size_t i=0; i<axes.size(); ++i)
-    {
-    auto axsize = shape[axes[i]];
-    auto othersize = fullsize/axsize;
-    auto sz = axsize*((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
-    if (sz>tmpsize) tmpsize=sz;
+  private:
+    std::unique_ptr<pocketfft_r<T0>> fftplan;
+    std::unique_ptr<T_dst1> evenplan;
+    std::unique_ptr<T_dcst23<T0>> oddplan;
+
+  public:
+    POCKETFFT_NOINLINE T_dst1(size_t length)
+      {
+      if ((length>=3) && ((length&1)==1))
+        {
+        evenplan.reset(new T_dst1(length/2));
+        oddplan.reset(new T_dcst23<T0>(length/2+1));
+        }
+      else
+        fftplan.reset(new pocketfft_r<T0>(2*(length+1)));
+      }
+    POCKETFFT_NOINLINE T_dst1(plan_reader &rd)
+      {
+      if (rd.get<std::uint8_t>()!=0)
+        {
+        evenplan.reset(new T_dst1(rd));
+        oddplan.reset(new T_dcst23<T0>(rd));
+        if (oddplan->length()!=evenplan->length()+1)
+          throw std::runtime_error("corrupt plan data");
+        }
+      else
+        {
+        fftplan.reset(new pocketfft_r<T0>(rd));
+        if (((fftplan->length()&1)!=0) || (fftplan->length()<4))
+          throw std::runtime_error("corrupt plan data");
+        }
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put(std::uint8_t(fftplan ? 0 : 1));
+      if (fftplan)
+        fftplan->serialize(wr);
+      else
+        { evenplan->serialize(wr); oddplan->serialize(wr); }
+      }
+
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
+      {
+      return fftplan ? fftplan->length()+fftplan->workspace_size()
+        : length()+std::max(evenplan->workspace_size(),
+                            oddplan->workspace_size());
+      }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct,
+      bool /*ortho*/, int type, bool cosine, T *buf, size_t nthreads=1) const
+      {
+      size_t N=length();
+      if (fftplan)
+        {
+        size_t NF=fftplan->length();
+        auto tmp = buf;
+        tmp[0] = tmp[N+1] = c[0]*0;
+        for (size_t i=0; i<N; ++i)
+          { tmp[i+1]=c[i]; tmp[NF-1-i]=-c[i]; }
+        fftplan->exec(tmp, fct, true, buf+NF, nthreads);
+        for (size_t i=0; i<N; ++i)
+          c[i] = -tmp[2*i+2];
+        }
+      else
+        {
+        size_t m=N/2;
+        auto u=buf, w=buf+m;
+        for (size_t j=0; j<m; ++j)
+          { u[j] = c[j]-c[N-1-j]; w[j] = c[j]+c[N-1-j]; }
+        w[m] = 2*c[m];
+        evenplan->exec(u, fct, false, type, cosine, buf+N, nthreads);
+        oddplan->exec(w, fct, false, 3, false, buf+N, nthreads);
+        for (size_t j=0; j<m; ++j)
+          { c[2*j] = w[j]; c[2*j+1] = u[j]; }
+        c[N-1] = w[m];
+        }
+      }
+    template<typename T> void exec(T c[], T0 fct, bool ortho, int type,
+      bool cosine) const
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, ortho, type, cosine, buf.data());
+      }
+
+    size_t length() const
+      { return fftplan ? fftplan->length()/2-1 : 2*evenplan->length()+1; }
+    size_t memory_size() const
+      {
+      return fftplan ? sizeof(*fftplan) + fftplan->memory_size()
+        : sizeof(*evenplan) + evenplan->memory_size()
+          + sizeof(*oddplan) + oddplan->memory_size();
+      }
+  };
+
+template<typename T0> class T_dcst4
+  {
+  private:
+    size_t N;
+    std::unique_ptr<pocketfft_c<T0>> fft;
+    std::unique_ptr<pocketfft_r<T0>> rfft;
+    arr<cmplx<T0>> C2mem;
+    const cmplx<T0> *C2;
+    std::shared_ptr<const void> ext; // owner of C2, if not in C2mem
+
+    /* even N: DCT-IV of the N values in(i), computed with a complex FFT of
+       length N/2 from
+       https://www.appletonaudio.com/blog/2013/derivation-of-fast-dct-4-algorithm-based-on-dft/
+       (without the factor 2 of the unnormalized transform); output i is
+       passed to out(i, value). */
+    template<typename T, typename Tin, typename Tout> void exec_even(
+      const Tin &in, const Tout &out, T0 fct, T *buf, size_t nthreads) const
+      {
+      size_t n2 = N/2;
+      auto y = reinterpret_cast<cmplx<T> *>(buf);
+      for(size_t i=0; i<n2; ++i)
+        {
+        y[i].Set(in(2*i),in(N-1-2*i));
+        y[i] *= C2[i];
+        }
+      fft->exec(y, fct, true, y+n2, nthreads);
+      for(size_t i=0, ic=n2-1; i<n2; ++i, --ic)
+        {
+        out(2*i  ,   y[i ].r*C2[i ].r-y[i ].i*C2[i ].i);
+        out(2*i+1, -(y[ic].i*C2[ic].r+y[ic].r*C2[ic].i));
+        }
+      }
+
+  public:
+    POCKETFFT_NOINLINE T_dcst4(size_t length)
+      : N(length),
+        fft((N&1) ? nullptr : new pocketfft_c<T0>(N/2)),
+        rfft((N&1)? new pocketfft_r<T0>(N) : nullptr),
+        C2mem((N&1) ? 0 : N/2), C2(C2mem.data())
+      {
+      if ((N&1)==0)
+        {
+        sincos_2pibyn<T0> tw(16*N);
+        for (size_t i=0; i<N/2; ++i)
+          C2mem[i] = conj(tw[8*i+1]);
+        }
+      }
+    POCKETFFT_NOINLINE T_dcst4(plan_reader &rd)
+      : N(rd.get_size()), C2(nullptr)
+      {
+      if (N==0) throw std::runtime_error("corrupt plan data");
+      if (N&1)
+        {
+        rfft.reset(new pocketfft_r<T0>(rd));
+        if (rfft->length()!=N) throw std::runtime_error("corrupt plan data");
+        }
+      else
+        {
+        fft.reset(new pocketfft_c<T0>(rd));
+        if (fft->length()!=N/2) throw std::runtime_error("corrupt plan data");
+        C2 = rd.get_array<cmplx<T0>>(N/2);
+        ext = rd.keepalive();
+        }
+      }
+
+    void serialize(plan_writer &wr) const
+      {
+      wr.put_size(N);
+      if (N&1)
+        rfft->serialize(wr);
+      else
+        {
+        fft->serialize(wr);
+        wr.put_array(C2, N/2);
+        }
+      }
+
+    /* number of elements of scratch space needed by exec() */
+    size_t workspace_size() const
+      { return (N&1) ? N+rfft->workspace_size() : N+2*fft->workspace_size(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct,
+      bool /*ortho*/, int /*type*/, bool cosine, T *buf,
+      size_t nthreads=1) const
+      {
+      size_t n2 = N/2;
+      if (!cosine)
+        for (size_t k=0, kc=N-1; k<n2; ++k, --kc)
+          std::swap(c[k], c[kc]);
+      if (N&1)
+        {
+        // The following code is derived from the FFTW3 function apply_re11()
+        // and is released under the 3-clause BSD license with friendly
+        // permission of Matteo Frigo and Steven G. Johnson.
+
+        auto y = buf;
+        {
+        size_t i=0, m=n2;
+        for (; m<N; ++i, m+=4)
+          y[i] = c[m];
+        for (; m<2*N; ++i, m+=4)
+          y[i] = -c[2*N-m-1];
+        for (; m<3*N; ++i, m+=4)
+          y[i] = -c[m-2*N];
+        for (; m<4*N; ++i, m+=4)
+          y[i] = c[4*N-m-1];
+        for (; i<N; ++i, m+=4)
+          y[i] = c[m-4*N];
+        }
+        rfft->exec(y, fct, true, buf+N, nthreads);
+        {
+        auto SGN = [](size_t i)
+           {
+           constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
+           return (i&2) ? -sqrt2 : sqrt2;
+           };
+        c[n2] = y[0]*SGN(n2+1);
+        size_t i=0, i1=1, k=1;
+        for (; k<n2; ++i, ++i1, k+=2)
+          {
+          c[i    ] = y[2*k-1]*SGN(i1)     + y[2*k  ]*SGN(i);
+          c[N -i1] = y[2*k-1]*SGN(N -i)   - y[2*k  ]*SGN(N -i1);
+          c[n2-i1] = y[2*k+1]*SGN(n2-i)   - y[2*k+2]*SGN(n2-i1);
+          c[n2+i1] = y[2*k+1]*SGN(n2+i+2) + y[2*k+2]*SGN(n2+i1);
+          }
+        if (k == n2)
+          {
+          c[i   ] = y[2*k-1]*SGN(i+1) + y[2*k]*SGN(i);
+          c[N-i1] = y[2*k-1]*SGN(i+2) + y[2*k]*SGN(i1);
+          }
+        }
+
+        // FFTW-derived code ends here
+        }
+      else
+        exec_even([c](size_t i) { return c[i]; },
+          [c](size_t i, const T &v) { c[i] = 2*v; }, fct, buf, nthreads);
+      if (!cosine)
+        for (size_t k=1; k<N; k+=2)
+          c[k] = -c[k];
+      }
+    template<typename T> void exec(T c[], T0 fct, bool ortho, int type,
+      bool cosine) const
+      {
+      arr<T> buf(workspace_size());
+      exec(c, fct, ortho, type, cosine, buf.data());
+      }
+
+    /* MDCT of the 2N values x[n] (multiplied by window[n], unless window is
+       null), written to c (which may be equal to x):
+         c[k] = fct * sum_n window[n]*x[n]*cos(pi/N*(n+1/2+N/2)*(k+1/2)).
+       Windowing and the folding of x into N values are done while packing
+       the input of the FFT, so N must be even. */
+    template<typename T> void mdct(const T x[], T c[], const T0 *window,
+      T0 fct, T *buf, size_t nthreads=1) const
+      {
+      size_t h=N/2;
+      auto xw = [x,window](size_t n) -> T
+        { return window ? T(x[n]*window[n]) : x[n]; };
+      exec_even([&xw,h](size_t m) -> T
+          {
+          return (m<h) ? T(-xw(3*h-1-m)-xw(3*h+m)) : T(xw(m-h)-xw(3*h-1-m));
+          },
+        [c](size_t i, const T &v) { c[i] = v; }, fct, buf, nthreads);
+      }
+    /* IMDCT of the N values c, written to x (which may be equal to c):
+         x[n] = fct * window[n] * sum_k c[k]*cos(pi/N*(n+1/2+N/2)*(k+1/2))
+       for n<2N. With fct=2/N and a window satisfying
+       window[n]^2+window[n+N]^2=1, overlap-adding the outputs of
+       consecutive frames (hop size N) cancels the time-domain aliasing and
+       reconstructs the input of mdct(). N must be even. */
+    template<typename T> void imdct(const T c[], T x[], const T0 *window,
+      T0 fct, T *buf, size_t nthreads=1) const
+      {
+      size_t h=N/2;
+      auto put = [x,window](size_t n, const T &v)
+        { x[n] = window ? T(v*window[n]) : v; };
+      exec_even([c](size_t i) { return c[i]; },
+        [&put,h](size_t m, const T &v)
+          {
+          put(3*h-1-m, -v);
+          if (m<h) put(3*h+m, -v); else put(m-h, v);
+          }, fct, buf, nthreads);
+      }
+
+    size_t length() const { return N; }
+    size_t memory_size() const
+      {
+      return C2mem.size()*sizeof(cmplx<T0>)
+        + (fft ? sizeof(*fft) + fft->memory_size() : 0)
+        + (rfft ? sizeof(*rfft) + rfft->memory_size() : 0);
+      }
+  };
+
+
+//
+// multi-D infrastructure
+//
+
+/* Process-wide cache of 1D plans, shared by all plan types. Lookup is a hash
+   table access; entries are kept in a list ordered by last use, and the
+   least recently used ones are dropped as soon as either the number of plans
+   or their total memory footprint exceeds the configured limits.
+
+   In front of the shared table, every thread keeps a few weak references to
+   the plans it used last, so that repeated lookups neither lock nor write to
+   shared memory. Since such hits bypass the LRU list, each entry carries a
+   "referenced" flag which they set; an entry found with this flag at the cold
+   end of the list gets a second chance instead of being evicted. Evicted
+   plans are released immediately (the front caches only hold weak
+   references), and clear() / set_limits() invalidate all front caches. */
+class plan_cache
+  {
+  private:
+    struct key_t
+      {
+      std::type_index type;
+      size_t length;
+      bool operator==(const key_t &other) const
+        { return (type==other.type) && (length==other.length); }
+      };
+    struct key_hash
+      {
+      size_t operator()(const key_t &k) const
+        { return k.type.hash_code() ^ (k.length*size_t(0x9e3779b97f4a7c15ULL)); }
+      };
+    struct entry
+      {
+      key_t key;
+      std::shared_ptr<void> plan;
+      size_t bytes;
+      std::shared_ptr<std::atomic<bool>> used;
+      };
+    using list_t = std::list<entry>;
+
+    struct front_entry
+      {
+      key_t key;
+      std::weak_ptr<void> plan;
+      std::shared_ptr<std::atomic<bool>> used;
+      };
+    struct front_cache
+      {
+      static constexpr size_t nmax=8;
+      size_t gen=0, next=0;
+      std::vector<front_entry> entries;
+
+      std::shared_ptr<void> find(const key_t &key)
+        {
+        for (auto &e: entries)
+          if (e.key==key)
+            {
+            auto p = e.plan.lock();
+            if (p && !e.used->load(std::memory_order_relaxed))
+              e.used->store(true, std::memory_order_relaxed);
+            return p;
+            }
+        return nullptr;
+        }
+      void add(const entry &e)
+        {
+        front_entry fe{e.key, e.plan, e.used};
+        for (auto &x: entries)
+          if (x.key==e.key)
+            { x = fe; return; }
+        if (entries.size()<nmax)
+          { entries.push_back(fe); return; }
+        entries[next] = fe;
+        next = (next+1)%nmax;
+        }
+      };
+
+    std::mutex mut;
+    list_t lru; // most recently used entry first
+    std::unordered_map<key_t, list_t::iterator, key_hash> index;
+    size_t max_plans, max_bytes, cur_bytes;
+    std::atomic<size_t> generation; // bumped when front caches become stale
+
+    static front_cache &get_front()
+      {
+      static thread_local front_cache front;
+      return front;
+      }
+
+    void shrink()
+      {
+      size_t chances = lru.size(); // bound the work if flags keep being set
+      while ((!lru.empty()) && ((lru.size()>max_plans) || (cur_bytes>max_bytes)))
+        {
+        if ((chances>0) && lru.back().used->exchange(false, std::memory_order_relaxed))
+          {
+          --chances;
+          lru.splice(lru.begin(), lru, --lru.end());
+          continue;
+          }
+        cur_bytes -= lru.back().bytes;
+        index.erase(lru.back().key);
+        lru.pop_back();
+        }
+      }
+
+    /* must be called with the lock held */
+    std::shared_ptr<void> find_locked(const key_t &key, front_cache &front)
+      {
+      auto it = index.find(key);
+      if (it==index.end()) return nullptr;
+      lru.splice(lru.begin(), lru, it->second);
+      front.add(*it->second);
+      return it->second->plan;
+      }
+
+    /* must be called with the lock held; returns true if the plan is still
+       cached after enforcing the limits */
+    bool insert_locked(const key_t &key, std::shared_ptr<void> plan,
+      size_t bytes, front_cache &front)
+      {
+      if ((max_plans==0) || (bytes>max_bytes)) return false;
+      lru.push_front(entry{key, plan, bytes,
+        std::make_shared<std::atomic<bool>>(false)});
+      index.emplace(key, lru.begin());
+      cur_bytes += bytes;
+      shrink();
+      // the new entry may have been evicted again if the limits are tiny
+      auto it = index.find(key);
+      if (it==index.end()) return false;
+      front.add(*it->second);
+      return true;
+      }
+
+  public:
+    plan_cache()
+      : max_plans(POCKETFFT_CACHE_SIZE), max_bytes(POCKETFFT_CACHE_MEMORY),
+        cur_bytes(0), generation(1) {}
+
+    template<typename T> std::shared_ptr<T> get(size_t length)
+      {
+      key_t key{typeid(T), length};
+      auto &front = get_front();
+      auto gen = generation.load(std::memory_order_acquire);
+      if (front.gen!=gen)
+        { front.entries.clear(); front.gen = gen; }
+      else
+        {
+        auto p = front.find(key);
+        if (p) return std::static_pointer_cast<T>(p);
+        }
+
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      auto p = find_locked(key, front);
+      if (p) return std::static_pointer_cast<T>(p);
+      }
+      auto plan = std::make_shared<T>(length);
+      size_t bytes = sizeof(T) + plan->memory_size();
+      std::lock_guard<std::mutex> lock(mut);
+      // another thread may have inserted the same plan in the meantime
+      auto p = find_locked(key, front);
+      if (p) return std::static_pointer_cast<T>(p);
+      insert_locked(key, plan, bytes, front);
+      return plan;
+      }
+
+    /* Adds an existing plan to the cache, replacing any plan of the same type
+       and length. Returns false if the plan does not fit into the limits. */
+    template<typename T> bool put(std::shared_ptr<T> plan)
+      {
+      key_t key{typeid(T), plan->length()};
+      size_t bytes = sizeof(T) + plan->memory_size();
+      std::lock_guard<std::mutex> lock(mut);
+      auto it = index.find(key);
+      if (it!=index.end())
+        {
+        cur_bytes -= it->second->bytes;
+        lru.erase(it->second);
+        index.erase(it);
+        ++generation;
+        }
+      return insert_locked(key, plan, bytes, get_front());
+      }
+
+    void set_limits(size_t max_plans_, size_t max_bytes_)
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      max_plans = max_plans_;
+      max_bytes = max_bytes_;
+      shrink();
+      ++generation;
+      }
+    size_t plan_limit()
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      return max_plans;
+      }
+    size_t memory_limit()
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      return max_bytes;
+      }
+    size_t memory_usage()
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      return cur_bytes;
+      }
+    void clear()
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      lru.clear();
+      index.clear();
+      cur_bytes = 0;
+      ++generation;
+      }
+  };
+
+inline plan_cache &get_plan_cache()
+  {
+  static plan_cache cache;
+  return cache;
+  }
+
+template<typename T> std::shared_ptr<T> get_plan(size_t length)
+  { return get_plan_cache().get<T>(length); }
+
+/* Sets the maximum number of plans and the maximum total memory (in bytes)
+   held by the plan cache. A limit of 0 plans disables caching. */
+inline void set_plan_cache_limits(size_t max_plans, size_t max_bytes)
+  { get_plan_cache().set_limits(max_plans, max_bytes); }
+inline void set_plan_cache_size(size_t max_plans)
+  {
+  auto &cache = get_plan_cache();
+  cache.set_limits(max_plans, cache.memory_limit());
+  }
+inline void set_plan_cache_memory(size_t max_bytes)
+  {
+  auto &cache = get_plan_cache();
+  cache.set_limits(cache.plan_limit(), max_bytes);
+  }
+inline size_t plan_cache_memory_usage()
+  { return get_plan_cache().memory_usage(); }
+inline void clear_plan_cache()
+  { get_plan_cache().clear(); }
+
+//
+// plan files
+//
+
+/* identifiers of the 1D plan types in plan files */
+template<typename T0, std::uint32_t id_> struct plan_file_kind_base
+  {
+  using scalar = T0;
+  static std::uint32_t id() { return id_; }
+  };
+template<typename Tplan> struct plan_file_kind {};
+template<typename T0> struct plan_file_kind<pocketfft_c<T0>>
+  : plan_file_kind_base<T0, 1> {};
+template<typename T0> struct plan_file_kind<pocketfft_r<T0>>
+  : plan_file_kind_base<T0, 2> {};
+template<typename T0> struct plan_file_kind<T_dct1<T0>>
+  : plan_file_kind_base<T0, 3> {};
+template<typename T0> struct plan_file_kind<T_dst1<T0>>
+  : plan_file_kind_base<T0, 4> {};
+template<typename T0> struct plan_file_kind<T_dcst23<T0>>
+  : plan_file_kind_base<T0, 5> {};
+template<typename T0> struct plan_file_kind<T_dcst4<T0>>
+  : plan_file_kind_base<T0, 6> {};
+
+/* File layout (native byte order):
+     header (64 bytes): magic, version, byte order mark, file size, number of
+       plans, FNV-1a checksum of everything following the header
+     directory: one entry per plan (kind, scalar size and mantissa digits,
+       length, offset and size of the plan data)
+     plan data, each starting at a multiple of 64 bytes */
+struct plan_file_header
+  {
+  char magic[8];
+  std::uint32_t version, bom;
+  std::uint64_t size, nplans, checksum;
+  char pad[24];
+  };
+struct plan_file_entry
+  {
+  std::uint32_t kind, scalar_size, scalar_digits, reserved;
+  std::uint64_t length, offset, size;
+  };
+constexpr std::uint32_t plan_file_version=7, plan_file_bom=0x01020304;
+
+inline const char *plan_file_magic() { return "POCKETFT"; }
+
+inline std::uint64_t plan_file_checksum(const char *data, size_t size)
+  {
+  std::uint64_t res=0xcbf29ce484222325ULL;
+  for (size_t i=0; i<size; ++i)
+    {
+    res ^= std::uint8_t(data[i]);
+    res *= 0x100000001b3ULL;
+    }
+  return res;
+  }
+
+/* A set of 1D plans which can be written to a file and later be loaded into
+   the plan cache with load_plans(). */
+class plan_set
+  {
+  private:
+    struct item
+      {
+      plan_file_entry entry;
+      std::vector<char> data;
+      };
+    std::vector<item> items;
+
+  public:
+    template<typename Tplan> void add(size_t length)
+      {
+      using T0 = typename plan_file_kind<Tplan>::scalar;
+      auto plan = get_plan<Tplan>(length);
+      plan_writer wr;
+      plan->serialize(wr);
+      plan_file_entry entry{plan_file_kind<Tplan>::id(),
+        std::uint32_t(sizeof(T0)),
+        std::uint32_t(std::numeric_limits<T0>::digits), 0, length, 0, 0};
+      items.push_back({entry, wr.data()});
+      }
+    /* plans used by c2c() */
+    template<typename T> void add_c2c(size_t length)
+      { add<pocketfft_c<T>>(length); }
+    /* plans used by r2c(), c2r(), r2r_fftpack() and the Hartley transforms */
+    template<typename T> void add_r2c(size_t length)
+      { add<pocketfft_r<T>>(length); }
+    template<typename T> void add_dct(int type, size_t length)
+      {
+      if ((type<1) || (type>4)) throw std::invalid_argument("invalid DCT type");
+      if (type==1) add<T_dct1<T>>(length);
+      else if (type==4) add<T_dcst4<T>>(length);
+      else add<T_dcst23<T>>(length);
+      }
+    template<typename T> void add_dst(int type, size_t length)
+      {
+      if ((type<1) || (type>4)) throw std::invalid_argument("invalid DST type");
+      if (type==1) add<T_dst1<T>>(length);
+      else if (type==4) add<T_dcst4<T>>(length);
+      else add<T_dcst23<T>>(length);
+      }
+
+    size_t size() const { return items.size(); }
+
+    void save(const std::string &filename) const
+      {
+      auto align = [](size_t ofs) { return (ofs+63)/64*64; };
+      size_t ofs = align(sizeof(plan_file_header)
+                         + items.size()*sizeof(plan_file_entry));
+      std::vector<plan_file_entry> dir;
+      for (const auto &it: items)
+        {
+        dir.push_back(it.entry);
+        dir.back().offset = ofs;
+        dir.back().size = it.data.size();
+        ofs = align(ofs+it.data.size());
+        }
+      std::vector<char> buf(ofs, 0);
+      if (!dir.empty())
+        std::memcpy(&buf[sizeof(plan_file_header)], dir.data(),
+          dir.size()*sizeof(plan_file_entry));
+      for (size_t i=0; i<items.size(); ++i)
+        if (!items[i].data.empty())
+          std::memcpy(&buf[size_t(dir[i].offset)], items[i].data.data(),
+            items[i].data.size());
+      plan_file_header hdr;
+      std::memset(&hdr, 0, sizeof(hdr));
+      std::memcpy(hdr.magic, plan_file_magic(), sizeof(hdr.magic));
+      hdr.version = plan_file_version;
+      hdr.bom = plan_file_bom;
+      hdr.size = buf.size();
+      hdr.nplans = items.size();
+      hdr.checksum = plan_file_checksum(buf.data()+sizeof(hdr),
+        buf.size()-sizeof(hdr));
+      std::memcpy(buf.data(), &hdr, sizeof(hdr));
+
+      FILE *f = std::fopen(filename.c_str(), "wb");
+      if (!f) throw std::runtime_error("cannot open plan file for writing");
+      bool ok = std::fwrite(buf.data(), 1, buf.size(), f)==buf.size();
+      ok = (std::fclose(f)==0) && ok;
+      if (!ok) throw std::runtime_error("error writing plan file");
+      }
+  };
+
+/* Makes the contents of a file available in memory, using mmap() where
+   possible. The returned pointer keeps the mapping alive. */
+inline std::shared_ptr<const void> map_plan_file(const std::string &filename,
+  size_t &size)
+  {
+#ifdef POCKETFFT_HAVE_MMAP
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd<0) throw std::runtime_error("cannot open plan file");
+  struct stat st;
+  if (::fstat(fd, &st)!=0)
+    { ::close(fd); throw std::runtime_error("cannot open plan file"); }
+  size = size_t(st.st_size);
+  if (size<sizeof(plan_file_header))
+    { ::close(fd); throw std::runtime_error("corrupt plan file"); }
+  void *ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (ptr==MAP_FAILED) throw std::runtime_error("cannot map plan file");
+  size_t sz = size;
+  return std::shared_ptr<const void>(ptr,
+    [sz](const void *p) { ::munmap(const_cast<void *>(p), sz); });
+#else
+  FILE *f = std::fopen(filename.c_str(), "rb");
+  if (!f) throw std::runtime_error("cannot open plan file");
+  std::vector<char> tmp;
+  char chunk[65536];
+  size_t n;
+  while ((n=std::fread(chunk, 1, sizeof(chunk), f))>0)
+    tmp.insert(tmp.end(), chunk, chunk+n);
+  std::fclose(f);
+  size = tmp.size();
+  if (size<sizeof(plan_file_header))
+    throw std::runtime_error("corrupt plan file");
+  auto mem = std::make_shared<arr<char>>(size);
+  std::memcpy(mem->data(), tmp.data(), size);
+  return std::shared_ptr<const void>(mem, mem->data());
+#endif
+  }
+
+template<typename T0> bool load_plan(std::uint32_t kind, size_t length,
+  plan_reader &rd)
+  {
+  auto check = [length](size_t len)
+    {
+    if (len!=length) throw std::runtime_error("corrupt plan file");
+    };
+  auto &cache = get_plan_cache();
+  switch (kind)
+    {
+    case 1:
+      {
+      auto plan = std::make_shared<pocketfft_c<T0>>(rd);
+      check(plan->length());
+      return cache.put(plan);
+      }
+    case 2:
+      {
+      auto plan = std::make_shared<pocketfft_r<T0>>(rd);
+      check(plan->length());
+      return cache.put(plan);
+      }
+    case 3:
+      {
+      auto plan = std::make_shared<T_dct1<T0>>(rd);
+      check(plan->length());
+      return cache.put(plan);
+      }
+    case 4:
+      {
+      auto plan = std::make_shared<T_dst1<T0>>(rd);
+      check(plan->length());
+      return cache.put(plan);
+      }
+    case 5:
+      {
+      auto plan = std::make_shared<T_dcst23<T0>>(rd);
+      check(plan->length());
+      return cache.put(plan);
+      }
+    case 6:
+      {
+      auto plan = std::make_shared<T_dcst4<T0>>(rd);
+      check(plan->length());
+      return cache.put(plan);
+      }
+    default:
+      throw std::runtime_error("unknown plan type in plan file");
+    }
+  }
+
+template<typename T0> bool scalar_matches(const plan_file_entry &e)
+  {
+  return (e.scalar_size==sizeof(T0))
+    && (e.scalar_digits==std::uint32_t(std::numeric_limits<T0>::digits));
+  }
+
+/* Loads all plans stored in a file written by plan_set::save() into the plan
+   cache. Twiddle factors are used directly from the memory-mapped file.
+   Returns the number of plans that were added to the cache (plans not
+   fitting into the cache limits are dropped). */
+inline size_t load_plans(const std::string &filename)
+  {
+  size_t size;
+  auto keep = map_plan_file(filename, size);
+  auto base = static_cast<const char *>(keep.get());
+  plan_file_header hdr;
+  std::memcpy(&hdr, base, sizeof(hdr));
+  if (std::memcmp(hdr.magic, plan_file_magic(), sizeof(hdr.magic))!=0)
+    throw std::runtime_error("not a plan file");
+  if (hdr.bom!=plan_file_bom)
+    throw std::runtime_error("plan file has wrong byte order");
+  if (hdr.version!=plan_file_version)
+    throw std::runtime_error("unsupported plan file version");
+  if ((hdr.size!=size)
+    || (hdr.nplans>(size-sizeof(hdr))/sizeof(plan_file_entry))
+    || (hdr.checksum!=plan_file_checksum(base+sizeof(hdr), size-sizeof(hdr))))
+    throw std::runtime_error("corrupt plan file");
+  size_t res=0;
+  for (size_t i=0; i<hdr.nplans; ++i)
+    {
+    plan_file_entry e;
+    std::memcpy(&e, base+sizeof(hdr)+i*sizeof(e), sizeof(e));
+    if ((e.offset%64!=0) || (e.offset>size) || (e.size>size-e.offset))
+      throw std::runtime_error("corrupt plan file");
+    plan_reader rd(base, size_t(e.offset), size_t(e.offset+e.size), keep);
+    size_t length = size_t(e.length);
+    bool added;
+    if (scalar_matches<float>(e))
+      added = load_plan<float>(e.kind, length, rd);
+    else if (scalar_matches<double>(e))
+      added = load_plan<double>(e.kind, length, rd);
+    else if (scalar_matches<long double>(e))
+      added = load_plan<long double>(e.kind, length, rd);
+    else
+      throw std::runtime_error("unsupported scalar type in plan file");
+    if (added) ++res;
+    }
+  return res;
+  }
+
+class arr_info
+  {
+  protected:
+    shape_t shp;
+    stride_t str;
+
+  public:
+    arr_info(const shape_t &shape_, const stride_t &stride_)
+      : shp(shape_), str(stride_) {}
+    size_t ndim() const { return shp.size(); }
+    size_t size() const { return util::prod(shp); }
+    const shape_t &shape() const { return shp; }
+    size_t shape(size_t i) const { return shp[i]; }
+    const stride_t &stride() const { return str; }
+    const ptrdiff_t &stride(size_t i) const { return str[i]; }
+  };
+
+template<typename T> class cndarr: public arr_info
+  {
+  protected:
+    const char *d;
+
+  public:
+    cndarr(const void *data_, const shape_t &shape_, const stride_t &stride_)
+      : arr_info(shape_, stride_),
+        d(reinterpret_cast<const char *>(data_)) {}
+    const T &operator[](ptrdiff_t ofs) const
+      { return *reinterpret_cast<const T *>(d+ofs); }
+    void set_data(const void *data_)
+      { d = reinterpret_cast<const char *>(data_); }
+  };
+
+template<typename T> class ndarr: public cndarr<T>
+  {
+  public:
+    ndarr(void *data_, const shape_t &shape_, const stride_t &stride_)
+      : cndarr<T>::cndarr(const_cast<const void *>(data_), shape_, stride_)
+      {}
+    T &operator[](ptrdiff_t ofs)
+      { return *reinterpret_cast<T *>(const_cast<char *>(cndarr<T>::d+ofs)); }
+    void set_data(void *data_)
+      { cndarr<T>::set_data(data_); }
+  };
+
+template<size_t N> class multi_iter
+  {
+  private:
+    shape_t pos;
+    const arr_info &iarr, &oarr;
+    /* at least two lines, for line pairs (see exec_pairs()) */
+    static constexpr size_t nmax = (N<2) ? 2 : N;
+    ptrdiff_t p_ii, p_i[nmax], str_i, p_oi, p_o[nmax], str_o;
+    size_t idim, rem;
+    const ptrdiff_t *lofs_i, *lofs_o; // precomputed line offsets (optional)
+
+    void advance_i()
+      {
+      for (int i_=int(pos.size())-1; i_>=0; --i_)
+        {
+        auto i = size_t(i_);
+        if (i==idim) continue;
+        p_ii += iarr.stride(i);
+        p_oi += oarr.stride(i);
+        if (++pos[i] < iarr.shape(i))
+          return;
+        pos[i] = 0;
+        p_ii -= ptrdiff_t(iarr.shape(i))*iarr.stride(i);
+        p_oi -= ptrdiff_t(oarr.shape(i))*oarr.stride(i);
+        }
+      }
+
+  public:
+    multi_iter(const arr_info &iarr_, const arr_info &oarr_, size_t idim_)
+      : pos(iarr_.ndim(), 0), iarr(iarr_), oarr(oarr_), p_ii(0),
+        str_i(iarr.stride(idim_)), p_oi(0), str_o(oarr.stride(idim_)),
+        idim(idim_), rem(iarr.size()/iarr.shape(idim)), lofs_i(nullptr),
+        lofs_o(nullptr)
+      {
+      auto nshares = threading::num_threads();
+      if (nshares==1) return;
+      if (nshares==0) throw std::runtime_error("can't run with zero threads");
+      auto myshare = threading::thread_id();
+      if (myshare>=nshares) throw std::runtime_error("impossible share requested");
+      size_t nbase = rem/nshares;
+      size_t additional = rem%nshares;
+      size_t lo = myshare*nbase + ((myshare<additional) ? myshare : additional);
+      size_t hi = lo+nbase+(myshare<additional);
+      size_t todo = hi-lo;
+
+      size_t chunk = rem;
+      for (size_t i=0; i<pos.size(); ++i)
+        {
+        if (i==idim) continue;
+        chunk /= iarr.shape(i);
+        size_t n_advance = lo/chunk;
+        pos[i] += n_advance;
+        p_ii += ptrdiff_t(n_advance)*iarr.stride(i);
+        p_oi += ptrdiff_t(n_advance)*oarr.stride(i);
+        lo -= n_advance*chunk;
+        }
+      rem = todo;
+      }
+    /* iterates over nlines lines whose offsets have been computed beforehand */
+    multi_iter(const arr_info &iarr_, const arr_info &oarr_, size_t idim_,
+      const ptrdiff_t *lofs_i_, const ptrdiff_t *lofs_o_, size_t nlines)
+      : iarr(iarr_), oarr(oarr_), p_ii(0), str_i(iarr.stride(idim_)), p_oi(0),
+        str_o(oarr.stride(idim_)), idim(idim_), rem(nlines), lofs_i(lofs_i_),
+        lofs_o(lofs_o_) {}
+    void advance(size_t n)
+      {
+      if (rem<n) throw std::runtime_error("underrun");
+      for (size_t i=0; i<n; ++i)
+        {
+        if (lofs_i)
+          { p_i[i] = *lofs_i++; p_o[i] = *lofs_o++; continue; }
+        p_i[i] = p_ii;
+        p_o[i] = p_oi;
+        advance_i();
+        }
+      rem -= n;
+      }
+    ptrdiff_t iofs(size_t i) const { return p_i[0] + ptrdiff_t(i)*str_i; }
+    ptrdiff_t iofs(size_t j, size_t i) const { return p_i[j] + ptrdiff_t(i)*str_i; }
+    ptrdiff_t oofs(size_t i) const { return p_o[0] + ptrdiff_t(i)*str_o; }
+    ptrdiff_t oofs(size_t j, size_t i) const { return p_o[j] + ptrdiff_t(i)*str_o; }
+    size_t length_in() const { return iarr.shape(idim); }
+    size_t length_out() const { return oarr.shape(idim); }
+    ptrdiff_t stride_in() const { return str_i; }
+    ptrdiff_t stride_out() const { return str_o; }
+    size_t remaining() const { return rem; }
+  };
+
+class simple_iter
+  {
+  private:
+    shape_t pos;
+    const arr_info &arr;
+    ptrdiff_t p;
+    size_t rem;
+
+  public:
+    simple_iter(const arr_info &arr_)
+      : pos(arr_.ndim(), 0), arr(arr_), p(0), rem(arr_.size()) {}
+    void advance()
+      {
+      --rem;
+      for (int i_=int(pos.size())-1; i_>=0; --i_)
+        {
+        auto i = size_t(i_);
+        p += arr.stride(i);
+        if (++pos[i] < arr.shape(i))
+          return;
+        pos[i] = 0;
+        p -= ptrdiff_t(arr.shape(i))*arr.stride(i);
+        }
+      }
+    ptrdiff_t ofs() const { return p; }
+    size_t remaining() const { return rem; }
+  };
+
+class rev_iter
+  {
+  private:
+    shape_t pos;
+    const arr_info &arr;
+    std::vector<char> rev_axis;
+    std::vector<char> rev_jump;
+    size_t last_axis, last_size;
+    shape_t shp;
+    ptrdiff_t p, rp;
+    size_t rem;
+
+  public:
+    rev_iter(const arr_info &arr_, const shape_t &axes)
+      : pos(arr_.ndim(), 0), arr(arr_), rev_axis(arr_.ndim(), 0),
+        rev_jump(arr_.ndim(), 1), p(0), rp(0)
+      {
+      for (auto ax: axes)
+        rev_axis[ax]=1;
+      last_axis = axes.back();
+      last_size = arr.shape(last_axis)/2 + 1;
+      shp = arr.shape();
+      shp[last_axis] = last_size;
+      rem=1;
+      for (auto i: shp)
+        rem *= i;
+      }
+    void advance()
+      {
+      --rem;
+      for (int i_=int(pos.size())-1; i_>=0; --i_)
+        {
+        auto i = size_t(i_);
+        p += arr.stride(i);
+        if (!rev_axis[i])
+          rp += arr.stride(i);
+        else
+          {
+          rp -= arr.stride(i);
+          if (rev_jump[i])
+            {
+            rp += ptrdiff_t(arr.shape(i))*arr.stride(i);
+            rev_jump[i] = 0;
+            }
+          }
+        if (++pos[i] < shp[i])
+          return;
+        pos[i] = 0;
+        p -= ptrdiff_t(shp[i])*arr.stride(i);
+        if (rev_axis[i])
+          {
+          rp -= ptrdiff_t(arr.shape(i)-shp[i])*arr.stride(i);
+          rev_jump[i] = 1;
+          }
+        else
+          rp -= ptrdiff_t(shp[i])*arr.stride(i);
+        }
+      }
+    ptrdiff_t ofs() const { return p; }
+    ptrdiff_t rev_ofs() const { return rp; }
+    size_t remaining() const { return rem; }
+  };
+
+template<typename T> arr<char> alloc_tmp(const shape_t &shape,
+  size_t axsize, size_t elemsize, size_t wsize=0)
+  {
+  auto othersize = util::prod(shape)/axsize;
+  auto tmpsize = (axsize+wsize)*((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
+  return arr<char>(tmpsize*elemsize);
+  }
+template<typename T> arr<char> alloc_tmp(const shape_t &shape,
+  const shape_t &axes, size_t elemsize)
+  {
+  size_t fullsize=util::prod(shape);
+  size_t tmpsize=0;
+  for (size_t i=0; i<axes.size(); ++i)
+    {
+    auto axsize = shape[axes[i]];
+    auto othersize = fullsize/axsize;
+    auto sz = axsize*((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
+    if (sz>tmpsize) tmpsize=sz;
+    }
+  return arr<char>(tmpsize*elemsize);
+  }
+
+template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
+  const cndarr<cmplx<T>> &src, cmplx<vtype_t<T>> *POCKETFFT_RESTRICT dst)
+  {
+  for (size_t i=0; i<it.length_in(); ++i)
+    for (size_t j=0; j<vlen; ++j)
+      {
+      dst[i].r[j] = src[it.iofs(j,i)].r;
+      dst[i].i[j] = src[it.iofs(j,i)].i;
+      }
+  }
+
+template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
+  const cndarr<T> &src, vtype_t<T> *POCKETFFT_RESTRICT dst)
+  {
+  for (size_t i=0; i<it.length_in(); ++i)
+    for (size_t j=0; j<vlen; ++j)
+      dst[i][j] = src[it.iofs(j,i)];
+  }
+
+template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
+  const cndarr<T> &src, T *POCKETFFT_RESTRICT dst)
+  {
+  if (dst == &src[it.iofs(0)]) return;  // in-place
+  for (size_t i=0; i<it.length_in(); ++i)
+    dst[i] = src[it.iofs(i)];
+  }
+
+/* Returns the input line of `it` if an out-of-place transform can read it
+   directly, otherwise copies it to dst and returns dst. */
+template <typename Tsrc, typename T, size_t vlen> const T *input_line(
+  const multi_iter<vlen> &it, const cndarr<Tsrc> &src, T *dst)
+  {
+  copy_input(it, src, dst);
+  return dst;
+  }
+template <typename T, size_t vlen> const T *input_line(
+  const multi_iter<vlen> &it, const cndarr<T> &src, T *dst)
+  {
+  if (it.stride_in() == sizeof(T)) return &src[it.iofs(0)];
+  copy_input(it, src, dst);
+  return dst;
+  }
+
+template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
+  const cmplx<vtype_t<T>> *POCKETFFT_RESTRICT src, ndarr<cmplx<T>> &dst)
+  {
+  for (size_t i=0; i<it.length_out(); ++i)
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,i)].Set(src[i].r[j],src[i].i[j]);
+  }
+
+template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
+  const vtype_t<T> *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+  {
+  for (size_t i=0; i<it.length_out(); ++i)
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,i)] = src[i][j];
+  }
+
+template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
+  const T *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+  {
+  if (src == &dst[it.oofs(0)]) return;  // in-place
+  for (size_t i=0; i<it.length_out(); ++i)
+    dst[it.oofs(i)] = src[i];
+  }
+
+template <typename T> struct add_vec { using type = vtype_t<T>; };
+template <typename T> struct add_vec<cmplx<T>>
+  { using type = cmplx<vtype_t<T>>; };
+template <typename T> using add_vec_t = typename add_vec<T>::type;
+
+/* true for the functors which can also transform two scalar lines at once
+   with a pocketfft_r plan, by providing a pair() member (see
+   pocketfft_r::exec_pair()) */
+template<typename Exec> struct exec_has_pairs: std::false_type {};
+
+template<typename Tin, typename Tout, typename Tplan, typename T0,
+  typename Exec, size_t vlen>
+void exec_pairs(multi_iter<vlen> &, const cndarr<Tin> &, ndarr<Tout> &,
+  char *, const Tplan &, T0, const Exec &, size_t, std::false_type) {}
+
+/* Transforms the lines of `it` which would not be handled in groups of vlen
+   two at a time, if the plan has chosen to do so. */
+template<typename Tin, typename Tout, typename Tplan, typename T0,
+  typename Exec, size_t vlen>
+void exec_pairs(multi_iter<vlen> &it, const cndarr<Tin> &in, ndarr<Tout> &out,
+  char *storage, const Tplan &plan, T0 fct, const Exec &exec,
+  size_t nthreads, std::true_type)
+  {
+  if (!plan.paired()) return;
+  size_t nscalar = (vlen>1) ? it.remaining()%vlen : it.remaining();
+  auto tdata = reinterpret_cast<cmplx<T0> *>(storage);
+  for (; nscalar>=2; nscalar-=2)
+    {
+    it.advance(2);
+    exec.pair(it, in, out, tdata, tdata+plan.length(), plan, fct, nthreads);
+    }
+  }
+
+/* Processes all lines remaining in `it`, in groups of vlen where possible.
+   `Tbuf` is the element type of the temporary line buffer; if it matches the
+   output type and `allow_inplace` is set, contiguous output lines are used
+   directly as buffers. The C2C, R2R and Hartley functors read contiguous
+   scalar input lines directly, see input_line(). `storage` holds the line
+   buffer (for the longest of input line, output line and transform)
+   followed by the scratch
+   space of `plan` (see alloc_tmp()). Single
+   lines are transformed using `nthreads` threads. Scalar lines may be transformed in pairs
+   beforehand, see exec_pairs(). */
+template<typename Tbuf, typename Tin, typename Tout, typename Tplan,
+  typename T0, typename Exec, size_t vlen>
+void exec_lines(multi_iter<vlen> &it, const cndarr<Tin> &in, ndarr<Tout> &out,
+  char *storage, const Tplan &plan, T0 fct, const Exec &exec,
+  bool allow_inplace, size_t nthreads=1)
+  {
+  exec_pairs(it, in, out, storage, plan, fct, exec, nthreads,
+    exec_has_pairs<Exec>());
+  size_t buflen = std::max(std::max(it.length_in(), it.length_out()),
+    plan.length());
+#ifndef POCKETFFT_NO_VECTORS
+  if (vlen>1)
+    while (it.remaining()>=vlen)
+      {
+      it.advance(vlen);
+      auto tdatav = reinterpret_cast<add_vec_t<Tbuf> *>(storage);
+      exec(it, in, out, tdatav, tdatav+buflen, plan, fct, 1);
+      }
+#endif
+  constexpr bool same_type = std::is_same<Tbuf, Tout>::value;
+  auto tdata = reinterpret_cast<Tbuf *>(storage);
+  while (it.remaining()>0)
+    {
+    it.advance(1);
+    auto buf = same_type && allow_inplace && it.stride_out() == sizeof(Tout) ?
+      reinterpret_cast<Tbuf *>(&out[it.oofs(0)]) : tdata;
+    exec(it, in, out, buf, tdata+buflen, plan, fct, nthreads);
+    }
+  }
+
+template<typename Tplan, typename T, typename T0, typename Exec>
+POCKETFFT_NOINLINE void general_nd(const cndarr<T> &in, ndarr<T> &out,
+  const shape_t &axes, T0 fct, size_t nthreads, const Exec & exec,
+  const bool allow_inplace=true)
+  {
+  std::shared_ptr<Tplan> plan;
+
+  for (size_t iax=0; iax<axes.size(); ++iax)
+    {
+    size_t len=in.shape(axes[iax]);
+    if ((!plan) || (len!=plan->length()))
+      plan = get_plan<Tplan>(len);
+
+    size_t nouter = util::thread_count(nthreads, in.shape(), axes[iax],
+      VLEN<T>::val);
+    size_t ninner = util::inner_thread_count(nthreads, nouter);
+    threading::thread_map(nouter,
+      [&] {
+        constexpr auto vlen = VLEN<T0>::val;
+        auto storage = alloc_tmp<T0>(in.shape(), len, sizeof(T),
+          plan->workspace_size());
+        const auto &tin(iax==0? in : out);
+        multi_iter<vlen> it(tin, out, axes[iax]);
+        exec_lines<T>(it, tin, out, storage.data(), *plan, fct, exec,
+          allow_inplace, ninner);
+      });  // end of parallel region
+    fct = T0(1); // factor has been applied, use 1 for remaining axes
+    }
+  }
+
+struct ExecC2C
+  {
+  bool forward;
+
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in,
+    ndarr<cmplx<T0>> &out, T * buf, T * scratch, const pocketfft_c<T0> &plan,
+    T0 fct, size_t nthreads) const
+    {
+    plan.exec(input_line(it, in, buf), buf, fct, forward, scratch, nthreads);
+    copy_output(it, buf, out);
+    }
+  };
+
+template <typename T, size_t vlen> void copy_hartley(const multi_iter<vlen> &it,
+  const vtype_t<T> *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+  {
+  for (size_t j=0; j<vlen; ++j)
+    dst[it.oofs(j,0)] = src[0][j];
+  size_t i=1, i1=1, i2=it.length_out()-1;
+  for (i=1; i<it.length_out()-1; i+=2, ++i1, --i2)
+    for (size_t j=0; j<vlen; ++j)
+      {
+        dst[it.oofs(j,i1)] = src[i][j]+src[i+1][j];
+        dst[it.oofs(j,i2)] = src[i][j]-src[i+1][j];
+      }
+  if (i<it.length_out())
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,i1)] = src[i][j];
+  }
+
+template <typename T, size_t vlen> void copy_hartley(const multi_iter<vlen> &it,
+  const T *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+  {
+  dst[it.oofs(0)] = src[0];
+  size_t i=1, i1=1, i2=it.length_out()-1;
+  for (i=1; i<it.length_out()-1; i+=2, ++i1, --i2)
+    {
+    dst[it.oofs(i1)] = src[i]+src[i+1];
+    dst[it.oofs(i2)] = src[i]-src[i+1];
+    }
+  if (i<it.length_out())
+    dst[it.oofs(i1)] = src[i];
+  }
+
+struct ExecHartley
+  {
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    plan.exec(input_line(it, in, buf), buf, fct, true, scratch, nthreads);
+    copy_hartley(it, buf, out);
+    }
+  };
+
+struct ExecDcst
+  {
+  bool ortho;
+  int type;
+  bool cosine;
+
+  template <typename T0, typename T, typename Tplan, size_t vlen>
+  void operator () (const multi_iter<vlen> &it, const cndarr<T0> &in,
+    ndarr<T0> &out, T * buf, T * scratch, const Tplan &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input(it, in, buf);
+    plan.exec(buf, fct, ortho, type, cosine, scratch, nthreads);
+    copy_output(it, buf, out);
+    }
+  };
+
+/* `len` is the length of the real transform; the real lines may be shorter
+   (zero padding or cropping) */
+template <typename T, size_t vlen> void copy_output_r2c(
+  const multi_iter<vlen> &it, const vtype_t<T> *POCKETFFT_RESTRICT src,
+  ndarr<cmplx<T>> &dst, bool forward, size_t len)
+  {
+  for (size_t j=0; j<vlen; ++j)
+    dst[it.oofs(j,0)].Set(src[0][j]);
+  size_t i=1, ii=1;
+  if (forward)
+    for (; i<len-1; i+=2, ++ii)
+      for (size_t j=0; j<vlen; ++j)
+        dst[it.oofs(j,ii)].Set(src[i][j], src[i+1][j]);
+  else
+    for (; i<len-1; i+=2, ++ii)
+      for (size_t j=0; j<vlen; ++j)
+        dst[it.oofs(j,ii)].Set(src[i][j], -src[i+1][j]);
+  if (i<len)
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,ii)].Set(src[i][j]);
+  }
+
+template <typename T, size_t vlen> void copy_output_r2c(
+  const multi_iter<vlen> &it, const T *POCKETFFT_RESTRICT src,
+  ndarr<cmplx<T>> &dst, bool forward, size_t len)
+  {
+  dst[it.oofs(0)].Set(src[0]);
+  size_t i=1, ii=1;
+  if (forward)
+    for (; i<len-1; i+=2, ++ii)
+      dst[it.oofs(ii)].Set(src[i], src[i+1]);
+  else
+    for (; i<len-1; i+=2, ++ii)
+      dst[it.oofs(ii)].Set(src[i], -src[i+1]);
+  if (i<len)
+    dst[it.oofs(ii)].Set(src[i]);
+  }
+
+template <typename T, size_t vlen> void copy_input_c2r(
+  const multi_iter<vlen> &it, const cndarr<cmplx<T>> &src,
+  vtype_t<T> *POCKETFFT_RESTRICT dst, bool forward,
+  size_t len)
+  {
+  for (size_t j=0; j<vlen; ++j)
+    dst[0][j]=src[it.iofs(j,0)].r;
+  size_t i=1, ii=1;
+  if (forward)
+    for (; i<len-1; i+=2, ++ii)
+      for (size_t j=0; j<vlen; ++j)
+        {
+        dst[i  ][j] =  src[it.iofs(j,ii)].r;
+        dst[i+1][j] = -src[it.iofs(j,ii)].i;
+        }
+  else
+    for (; i<len-1; i+=2, ++ii)
+      for (size_t j=0; j<vlen; ++j)
+        {
+        dst[i  ][j] = src[it.iofs(j,ii)].r;
+        dst[i+1][j] = src[it.iofs(j,ii)].i;
+        }
+  if (i<len)
+    for (size_t j=0; j<vlen; ++j)
+      dst[i][j] = src[it.iofs(j,ii)].r;
+  }
+
+template <typename T, size_t vlen> void copy_input_c2r(
+  const multi_iter<vlen> &it, const cndarr<cmplx<T>> &src,
+  T *POCKETFFT_RESTRICT dst, bool forward,
+  size_t len)
+  {
+  dst[0]=src[it.iofs(0)].r;
+  size_t i=1, ii=1;
+  if (forward)
+    for (; i<len-1; i+=2, ++ii)
+      {
+      dst[i  ] =  src[it.iofs(ii)].r;
+      dst[i+1] = -src[it.iofs(ii)].i;
+      }
+  else
+    for (; i<len-1; i+=2, ++ii)
+      {
+      dst[i  ] = src[it.iofs(ii)].r;
+      dst[i+1] = src[it.iofs(ii)].i;
+      }
+  if (i<len)
+    dst[i] = src[it.iofs(ii)].r;
+  }
+
+/* copy functions for line pairs in the layout of pocketfft_r::exec_pair() */
+template <typename T, size_t vlen> void copy_input_pair(
+  const multi_iter<vlen> &it, const cndarr<T> &src,
+  cmplx<T> *POCKETFFT_RESTRICT dst)
+  {
+  for (size_t i=0; i<it.length_in(); ++i)
+    dst[i].Set(src[it.iofs(0,i)], src[it.iofs(1,i)]);
+  }
+
+template <typename T, size_t vlen> void copy_output_pair(
+  const multi_iter<vlen> &it, const cmplx<T> *POCKETFFT_RESTRICT src,
+  ndarr<T> &dst)
+  {
+  for (size_t i=0; i<it.length_out(); ++i)
+    {
+    dst[it.oofs(0,i)] = src[i].r;
+    dst[it.oofs(1,i)] = src[i].i;
+    }
+  }
+
+template <typename T, size_t vlen> void copy_output_r2c_pair(
+  const multi_iter<vlen> &it, const cmplx<T> *POCKETFFT_RESTRICT src,
+  ndarr<cmplx<T>> &dst, bool forward)
+  {
+  size_t len=it.length_in();
+  dst[it.oofs(0,0)].Set(src[0].r);
+  dst[it.oofs(1,0)].Set(src[0].i);
+  size_t k=1;
+  if (forward)
+    for (; k<len-k; ++k)
+      {
+      dst[it.oofs(0,k)] = src[k];
+      dst[it.oofs(1,k)] = src[len-k];
+      }
+  else
+    for (; k<len-k; ++k)
+      {
+      dst[it.oofs(0,k)] = conj(src[k]);
+      dst[it.oofs(1,k)] = conj(src[len-k]);
+      }
+  if (k==len-k)
+    {
+    dst[it.oofs(0,k)].Set(src[k].r);
+    dst[it.oofs(1,k)].Set(src[k].i);
+    }
+  }
+
+template <typename T, size_t vlen> void copy_input_c2r_pair(
+  const multi_iter<vlen> &it, const cndarr<cmplx<T>> &src,
+  cmplx<T> *POCKETFFT_RESTRICT dst, bool forward)
+  {
+  size_t len=it.length_out();
+  dst[0].Set(src[it.iofs(0,0)].r, src[it.iofs(1,0)].r);
+  size_t k=1;
+  if (forward)
+    for (; k<len-k; ++k)
+      {
+      dst[k] = conj(src[it.iofs(0,k)]);
+      dst[len-k] = conj(src[it.iofs(1,k)]);
+      }
+  else
+    for (; k<len-k; ++k)
+      {
+      dst[k] = src[it.iofs(0,k)];
+      dst[len-k] = src[it.iofs(1,k)];
+      }
+  if (k==len-k)
+    dst[k].Set(src[it.iofs(0,k)].r, src[it.iofs(1,k)].r);
+  }
+
+/* the same for FFTPACK's halfcomplex storage; the imaginary parts are
+   negated if `flip` is set */
+template <typename T, size_t vlen> void copy_output_hc_pair(
+  const multi_iter<vlen> &it, const cmplx<T> *POCKETFFT_RESTRICT src,
+  ndarr<T> &dst, bool flip)
+  {
+  size_t len=it.length_out();
+  T sign = flip ? T(-1) : T(1);
+  dst[it.oofs(0,0)] = src[0].r;
+  dst[it.oofs(1,0)] = src[0].i;
+  size_t k=1;
+  for (; k<len-k; ++k)
+    {
+    dst[it.oofs(0,2*k-1)] = src[k].r;
+    dst[it.oofs(0,2*k)] = sign*src[k].i;
+    dst[it.oofs(1,2*k-1)] = src[len-k].r;
+    dst[it.oofs(1,2*k)] = sign*src[len-k].i;
+    }
+  if (k==len-k)
+    {
+    dst[it.oofs(0,len-1)] = src[k].r;
+    dst[it.oofs(1,len-1)] = src[k].i;
+    }
+  }
+
+template <typename T, size_t vlen> void copy_input_hc_pair(
+  const multi_iter<vlen> &it, const cndarr<T> &src,
+  cmplx<T> *POCKETFFT_RESTRICT dst, bool flip)
+  {
+  size_t len=it.length_in();
+  T sign = flip ? T(-1) : T(1);
+  dst[0].Set(src[it.iofs(0,0)], src[it.iofs(1,0)]);
+  size_t k=1;
+  for (; k<len-k; ++k)
+    {
+    dst[k].Set(src[it.iofs(0,2*k-1)], sign*src[it.iofs(0,2*k)]);
+    dst[len-k].Set(src[it.iofs(1,2*k-1)], sign*src[it.iofs(1,2*k)]);
+    }
+  if (k==len-k)
+    dst[k].Set(src[it.iofs(0,len-1)], src[it.iofs(1,len-1)]);
+  }
+
+struct ExecR2C
+  {
+  bool forward;
+
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<cmplx<T0>> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input(it, in, buf);
+    plan.exec(buf, fct, true, scratch, nthreads);
+    copy_output_r2c(it, buf, out, forward, plan.length());
+    }
+
+  template <typename T0, size_t vlen> void pair(const multi_iter<vlen> &it,
+    const cndarr<T0> &in, ndarr<cmplx<T0>> &out, cmplx<T0> *buf,
+    cmplx<T0> *scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_pair(it, in, buf);
+    plan.exec_pair(buf, fct, true, scratch, nthreads);
+    copy_output_r2c_pair(it, buf, out, forward);
+    }
+  };
+template<> struct exec_has_pairs<ExecR2C>: std::true_type {};
+
+struct ExecC2R
+  {
+  bool forward;
+
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_c2r(it, in, buf, forward, plan.length());
+    plan.exec(buf, fct, false, scratch, nthreads);
+    copy_output(it, buf, out);
+    }
+
+  template <typename T0, size_t vlen> void pair(const multi_iter<vlen> &it,
+    const cndarr<cmplx<T0>> &in, ndarr<T0> &out, cmplx<T0> *buf,
+    cmplx<T0> *scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_c2r_pair(it, in, buf, forward);
+    plan.exec_pair(buf, fct, false, scratch, nthreads);
+    copy_output_pair(it, buf, out);
+    }
+  };
+template<> struct exec_has_pairs<ExecC2R>: std::true_type {};
+
+/* copy functions which multiply the input lines by window[] on the way
+   (used for the STFT) */
+template <typename T, size_t vlen> void copy_input_windowed(
+  const multi_iter<vlen> &it, const cndarr<T> &src, const T *window,
+  vtype_t<T> *POCKETFFT_RESTRICT dst)
+  {
+  for (size_t i=0; i<it.length_in(); ++i)
+    for (size_t j=0; j<vlen; ++j)
+      dst[i][j] = src[it.iofs(j,i)]*window[i];
+  }
+
+template <typename T, size_t vlen> void copy_input_windowed(
+  const multi_iter<vlen> &it, const cndarr<T> &src, const T *window,
+  T *POCKETFFT_RESTRICT dst)
+  {
+  for (size_t i=0; i<it.length_in(); ++i)
+    dst[i] = src[it.iofs(i)]*window[i];
+  }
+
+template <typename T, size_t vlen> void copy_input_windowed_pair(
+  const multi_iter<vlen> &it, const cndarr<T> &src, const T *window,
+  cmplx<T> *POCKETFFT_RESTRICT dst)
+  {
+  for (size_t i=0; i<it.length_in(); ++i)
+    dst[i].Set(src[it.iofs(0,i)]*window[i], src[it.iofs(1,i)]*window[i]);
+  }
+
+template<typename T0> struct ExecR2CWindowed
+  {
+  const T0 *window;
+  bool forward;
+
+  template <typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<cmplx<T0>> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_windowed(it, in, window, buf);
+    plan.exec(buf, fct, true, scratch, nthreads);
+    copy_output_r2c(it, buf, out, forward, plan.length());
+    }
+
+  template <size_t vlen> void pair(const multi_iter<vlen> &it,
+    const cndarr<T0> &in, ndarr<cmplx<T0>> &out, cmplx<T0> *buf,
+    cmplx<T0> *scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_windowed_pair(it, in, window, buf);
+    plan.exec_pair(buf, fct, true, scratch, nthreads);
+    copy_output_r2c_pair(it, buf, out, forward);
+    }
+  };
+template<typename T0> struct exec_has_pairs<ExecR2CWindowed<T0>>
+  : std::true_type {};
+
+template<typename T> inline T spectrum_from_power(spectrum mode, T p)
+  {
+  return (mode==spectrum::power) ? p :
+         (mode==spectrum::magnitude) ? T(std::sqrt(p)) : T(std::log(p));
+  }
+
+/* like copy_output_r2c(), but writes the real values selected by `mode` */
+template <typename T, size_t vlen> void copy_output_spectrum(
+  const multi_iter<vlen> &it, const vtype_t<T> *POCKETFFT_RESTRICT src,
+  ndarr<T> &dst, spectrum mode)
+  {
+  size_t len=it.length_in();
+  for (size_t j=0; j<vlen; ++j)
+    dst[it.oofs(j,0)] = spectrum_from_power(mode, src[0][j]*src[0][j]);
+  size_t i=1, ii=1;
+  for (; i<len-1; i+=2, ++ii)
+    {
+    vtype_t<T> p = src[i]*src[i] + src[i+1]*src[i+1];
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,ii)] = spectrum_from_power(mode, p[j]);
+    }
+  if (i<len)
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,ii)] = spectrum_from_power(mode, src[i][j]*src[i][j]);
+  }
+
+template <typename T, size_t vlen> void copy_output_spectrum(
+  const multi_iter<vlen> &it, const T *POCKETFFT_RESTRICT src,
+  ndarr<T> &dst, spectrum mode)
+  {
+  size_t len=it.length_in();
+  dst[it.oofs(0)] = spectrum_from_power(mode, src[0]*src[0]);
+  size_t i=1, ii=1;
+  for (; i<len-1; i+=2, ++ii)
+    dst[it.oofs(ii)] =
+      spectrum_from_power(mode, src[i]*src[i]+src[i+1]*src[i+1]);
+  if (i<len)
+    dst[it.oofs(ii)] = spectrum_from_power(mode, src[i]*src[i]);
+  }
+
+template <typename T, size_t vlen> void copy_output_spectrum_pair(
+  const multi_iter<vlen> &it, const cmplx<T> *POCKETFFT_RESTRICT src,
+  ndarr<T> &dst, spectrum mode)
+  {
+  size_t len=it.length_in();
+  dst[it.oofs(0,0)] = spectrum_from_power(mode, src[0].r*src[0].r);
+  dst[it.oofs(1,0)] = spectrum_from_power(mode, src[0].i*src[0].i);
+  size_t k=1;
+  for (; k<len-k; ++k)
+    {
+    auto a=src[k], b=src[len-k];
+    dst[it.oofs(0,k)] = spectrum_from_power(mode, a.r*a.r+a.i*a.i);
+    dst[it.oofs(1,k)] = spectrum_from_power(mode, b.r*b.r+b.i*b.i);
+    }
+  if (k==len-k)
+    {
+    dst[it.oofs(0,k)] = spectrum_from_power(mode, src[k].r*src[k].r);
+    dst[it.oofs(1,k)] = spectrum_from_power(mode, src[k].i*src[k].i);
+    }
+  }
+
+struct ExecR2CSpectrum
+  {
+  spectrum mode;
+
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input(it, in, buf);
+    plan.exec(buf, fct, true, scratch, nthreads);
+    copy_output_spectrum(it, buf, out, mode);
+    }
+
+  template <typename T0, size_t vlen> void pair(const multi_iter<vlen> &it,
+    const cndarr<T0> &in, ndarr<T0> &out, cmplx<T0> *buf,
+    cmplx<T0> *scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_pair(it, in, buf);
+    plan.exec_pair(buf, fct, true, scratch, nthreads);
+    copy_output_spectrum_pair(it, buf, out, mode);
+    }
+  };
+template<> struct exec_has_pairs<ExecR2CSpectrum>: std::true_type {};
+
+/* Applies `exec` to all lines along `axis` using a real plan of length len,
+   which may differ from the lengths of the input and output lines (e.g. for
+   zero padding or cropping). */
+template<typename T, typename Tin, typename Tout, typename Exec>
+POCKETFFT_NOINLINE void general_real_lines(const cndarr<Tin> &in,
+  ndarr<Tout> &out, size_t axis, size_t len, T fct, size_t nthreads,
+  const Exec &exec)
+  {
+  auto plan = get_plan<pocketfft_r<T>>(len);
+  shape_t tshape(in.shape());
+  tshape[axis] = len;
+  size_t nouter = util::thread_count(nthreads, in.shape(), axis, VLEN<T>::val);
+  size_t ninner = util::inner_thread_count(nthreads, nouter);
+  threading::thread_map(nouter,
+    [&] {
+    constexpr auto vlen = VLEN<T>::val;
+    auto storage = alloc_tmp<T>(tshape, len, sizeof(T),
+      plan->workspace_size());
+    multi_iter<vlen> it(in, out, axis);
+    exec_lines<T>(it, in, out, storage.data(), *plan, fct, exec, false,
+      ninner);
+    });  // end of parallel region
+  }
+
+/* `exec` is ExecR2C or one of its variants, which differ in the treatment
+   of the input lines or in the output format. */
+template<typename T, typename Tout, typename Exec> void general_r2c(
+  const cndarr<T> &in, ndarr<Tout> &out, size_t axis, T fct, size_t nthreads,
+  const Exec &exec)
+  { general_real_lines(in, out, axis, in.shape(axis), fct, nthreads, exec); }
+template<typename T> void general_c2r(const cndarr<cmplx<T>> &in,
+  ndarr<T> &out, size_t axis, bool forward, T fct, size_t nthreads)
+  {
+  general_real_lines(in, out, axis, out.shape(axis), fct, nthreads,
+    ExecC2R{forward});
+  }
+
+template<typename T0> struct ExecMdct
+  {
+  const T0 *window;
+  bool forward;
+
+  template <typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const T_dcst4<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input(it, in, buf);
+    if (forward)
+      plan.mdct(buf, buf, window, fct, scratch, nthreads);
+    else
+      plan.imdct(buf, buf, window, fct, scratch, nthreads);
+    copy_output(it, buf, out);
+    }
+  };
+
+/* MDCT (forward) or IMDCT along `axis`; the time-domain lines are twice as
+   long as the coefficient lines. */
+template<typename T> POCKETFFT_NOINLINE void general_mdct(
+  const cndarr<T> &in, ndarr<T> &out, size_t axis, const T *window,
+  bool forward, T fct, size_t nthreads)
+  {
+  size_t len = forward ? in.shape(axis) : out.shape(axis);
+  auto plan = get_plan<T_dcst4<T>>(len/2);
+  size_t nouter = util::thread_count(nthreads, in.shape(), axis, VLEN<T>::val);
+  size_t ninner = util::inner_thread_count(nthreads, nouter);
+  threading::thread_map(nouter,
+    [&] {
+    constexpr auto vlen = VLEN<T>::val;
+    auto storage = alloc_tmp<T>(forward ? in.shape() : out.shape(), len,
+      sizeof(T), plan->workspace_size());
+    multi_iter<vlen> it(in, out, axis);
+    exec_lines<T>(it, in, out, storage.data(), *plan, fct,
+      ExecMdct<T>{window, forward}, false, ninner);
+    });  // end of parallel region
+  }
+
+/* adds the window-weighted output lines to dst (overlap-add for the ISTFT);
+   a null window counts as rectangular */
+template<typename T, size_t vlen> void add_output_windowed(
+  const multi_iter<vlen> &it, const vtype_t<T> *POCKETFFT_RESTRICT src,
+  const T *window, ndarr<T> &dst)
+  {
+  for (size_t i=0; i<it.length_out(); ++i)
+    {
+    T w = window ? window[i] : T(1);
+    for (size_t j=0; j<vlen; ++j)
+      dst[it.oofs(j,i)] += src[i][j]*w;
+    }
+  }
+
+template<typename T, size_t vlen> void add_output_windowed(
+  const multi_iter<vlen> &it, const T *POCKETFFT_RESTRICT src,
+  const T *window, ndarr<T> &dst)
+  {
+  for (size_t i=0; i<it.length_out(); ++i)
+    dst[it.oofs(i)] += src[i]*(window ? window[i] : T(1));
+  }
+
+template<typename T, size_t vlen> void add_output_windowed_pair(
+  const multi_iter<vlen> &it, const cmplx<T> *POCKETFFT_RESTRICT src,
+  const T *window, ndarr<T> &dst)
+  {
+  for (size_t i=0; i<it.length_out(); ++i)
+    {
+    T w = window ? window[i] : T(1);
+    dst[it.oofs(0,i)] += src[i].r*w;
+    dst[it.oofs(1,i)] += src[i].i*w;
+    }
+  }
+
+template<typename T0> struct ExecIstft
+  {
+  const T0 *window;
+  bool forward;
+
+  template <typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_c2r(it, in, buf, forward, plan.length());
+    plan.exec(buf, fct, false, scratch, nthreads);
+    add_output_windowed(it, buf, window, out);
+    }
+
+  template <size_t vlen> void pair(const multi_iter<vlen> &it,
+    const cndarr<cmplx<T0>> &in, ndarr<T0> &out, cmplx<T0> *buf,
+    cmplx<T0> *scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_c2r_pair(it, in, buf, forward);
+    plan.exec_pair(buf, fct, false, scratch, nthreads);
+    add_output_windowed_pair(it, buf, window, out);
+    }
+  };
+template<typename T0> struct exec_has_pairs<ExecIstft<T0>>
+  : std::true_type {};
+
+/* Overlap-add synthesis of the `nframes` spectra in `in` (shape
+   {nframes, nperseg/2+1}) into the signal `out`, which must be zeroed
+   beforehand. Frame j covers the samples [j*hop, j*hop+nperseg). Frames
+   whose indices differ by at least ceil(nperseg/hop) do not overlap, so the
+   frames are processed in that many rounds, each of which is distributed
+   over the threads without write conflicts. */
+template<typename T> POCKETFFT_NOINLINE void general_istft(
+  const cndarr<cmplx<T>> &in, T *out, ptrdiff_t stride_out, size_t nperseg,
+  size_t hop, const T *window, bool forward, T fct, size_t nthreads)
+  {
+  auto plan = get_plan<pocketfft_r<T>>(nperseg);
+  size_t nframes = in.shape(0);
+  size_t nrounds = std::min((nperseg+hop-1)/hop, nframes);
+  for (size_t r=0; r<nrounds; ++r)
+    {
+    size_t nf = (nframes-r+nrounds-1)/nrounds;
+    cndarr<cmplx<T>> ain(&in[ptrdiff_t(r)*in.stride(0)],
+      {nf, in.shape(1)}, {ptrdiff_t(nrounds)*in.stride(0), in.stride(1)});
+    ndarr<T> aout(reinterpret_cast<char *>(out)
+      + ptrdiff_t(r*hop)*stride_out, {nf, nperseg},
+      {ptrdiff_t(nrounds*hop)*stride_out, stride_out});
+    size_t nouter = util::thread_count(nthreads, aout.shape(), 1,
+      VLEN<T>::val);
+    size_t ninner = util::inner_thread_count(nthreads, nouter);
+    threading::thread_map(nouter,
+      [&] {
+      constexpr auto vlen = VLEN<T>::val;
+      auto storage = alloc_tmp<T>(aout.shape(), nperseg, sizeof(T),
+        plan->workspace_size());
+      multi_iter<vlen> it(ain, aout, 1);
+      exec_lines<T>(it, ain, aout, storage.data(), *plan, fct,
+        ExecIstft<T>{window, forward}, false, ninner);
+      });  // end of parallel region
+    }
+  }
+
+struct ExecR2R
+  {
+  bool r2h, forward;
+
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out, T * buf,
+    T * scratch, const pocketfft_r<T0> &plan, T0 fct, size_t nthreads) const
+    {
+    if ((!r2h) && forward)
+      {
+      copy_input(it, in, buf);
+      for (size_t i=2; i<it.length_out(); i+=2)
+        buf[i] = -buf[i];
+      plan.exec(buf, fct, r2h, scratch, nthreads);
+      }
+    else
+      plan.exec(input_line(it, in, buf), buf, fct, r2h, scratch, nthreads);
+    if (r2h && (!forward))
+      for (size_t i=2; i<it.length_out(); i+=2)
+        buf[i] = -buf[i];
+    copy_output(it, buf, out);
+    }
+
+  template <typename T0, size_t vlen> void pair(const multi_iter<vlen> &it,
+    const cndarr<T0> &in, ndarr<T0> &out, cmplx<T0> *buf, cmplx<T0> *scratch,
+    const pocketfft_r<T0> &plan, T0 fct, size_t nthreads) const
+    {
+    if (r2h)
+      copy_input_pair(it, in, buf);
+    else
+      copy_input_hc_pair(it, in, buf, forward);
+    plan.exec_pair(buf, fct, r2h, scratch, nthreads);
+    if (r2h)
+      copy_output_hc_pair(it, buf, out, !forward);
+    else
+      copy_output_pair(it, buf, out);
+    }
+  };
+template<> struct exec_has_pairs<ExecR2R>: std::true_type {};
+
+template<typename T> void c2c(const shape_t &shape, const stride_t &stride_in,
+  const stride_t &stride_out, const shape_t &axes, bool forward,
+  const std::complex<T> *data_in, std::complex<T> *data_out, T fct,
+  size_t nthreads=1)
+  {
+  if (util::prod(shape)==0) return;
+  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
+  cndarr<cmplx<T>> ain(data_in, shape, stride_in);
+  ndarr<cmplx<T>> aout(data_out, shape, stride_out);
+  general_nd<pocketfft_c<T>>(ain, aout, axes, fct, nthreads, ExecC2C{forward});
+  }
+
+template<typename T> void dct(const shape_t &shape,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  int type, const T *data_in, T *data_out, T fct, bool ortho, size_t nthreads=1)
+  {
+  if ((type<1) || (type>4)) throw std::invalid_argument("invalid DCT type");
+  if (util::prod(shape)==0) return;
+  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
+  cndarr<T> ain(data_in, shape, stride_in);
+  ndarr<T> aout(data_out, shape, stride_out);
+  const ExecDcst exec{ortho, type, true};
+  if (type==1)
+    general_nd<T_dct1<T>>(ain, aout, axes, fct, nthreads, exec);
+  else if (type==4)
+    general_nd<T_dcst4<T>>(ain, aout, axes, fct, nthreads, exec);
+  else
+    general_nd<T_dcst23<T>>(ain, aout, axes, fct, nthreads, exec);
+  }
+
+template<typename T> void dst(const shape_t &shape,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  int type, const T *data_in, T *data_out, T fct, bool ortho, size_t nthreads=1)
+  {
+  if ((type<1) || (type>4)) throw std::invalid_argument("invalid DST type");
+  if (util::prod(shape)==0) return;
+  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
+  cndarr<T> ain(data_in, shape, stride_in);
+  ndarr<T> aout(data_out, shape, stride_out);
+  const ExecDcst exec{ortho, type, false};
+  if (type==1)
+    general_nd<T_dst1<T>>(ain, aout, axes, fct, nthreads, exec);
+  else if (type==4)
+    general_nd<T_dcst4<T>>(ain, aout, axes, fct, nthreads, exec);
+  else
+    general_nd<T_dcst23<T>>(ain, aout, axes, fct, nthreads, exec);
+  }
+
+template<typename T> void mdct(const shape_t &shape_in,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  const T *window, const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  if (util::prod(shape_in)==0) return;
+  util::sanity_check(shape_in, stride_in, stride_out, false, axis);
+  if ((shape_in[axis]&3)!=0)
+    throw std::invalid_argument("MDCT frame length must be a multiple of 4");
+  cndarr<T> ain(data_in, shape_in, stride_in);
+  shape_t shape_out(shape_in);
+  shape_out[axis] = shape_in[axis]/2;
+  ndarr<T> aout(data_out, shape_out, stride_out);
+  general_mdct(ain, aout, axis, window, true, fct, nthreads);
+  }
+
+template<typename T> void imdct(const shape_t &shape_out,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  const T *window, const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  if (util::prod(shape_out)==0) return;
+  util::sanity_check(shape_out, stride_in, stride_out, false, axis);
+  if ((shape_out[axis]&3)!=0)
+    throw std::invalid_argument("MDCT frame length must be a multiple of 4");
+  shape_t shape_in(shape_out);
+  shape_in[axis] = shape_out[axis]/2;
+  cndarr<T> ain(data_in, shape_in, stride_in);
+  ndarr<T> aout(data_out, shape_out, stride_out);
+  general_mdct(ain, aout, axis, window, false, fct, nthreads);
+  }
+
+template<typename T> void stft(size_t len, ptrdiff_t stride_in,
+  const stride_t &stride_out, size_t nperseg, size_t hop, const T *window,
+  bool forward, const T *data_in, std::complex<T> *data_out, T fct,
+  size_t nthreads=1)
+  {
+  size_t nframes = stft_frames(len, nperseg, hop);
+  if (nframes==0) return;
+  if (stride_out.size()!=2)
+    throw std::runtime_error("stride dimension mismatch");
+  cndarr<T> ain(data_in, {nframes, nperseg},
+    {ptrdiff_t(hop)*stride_in, stride_in});
+  ndarr<cmplx<T>> aout(data_out, {nframes, nperseg/2+1}, stride_out);
+  if (window)
+    general_r2c(ain, aout, 1, fct, nthreads,
+      ExecR2CWindowed<T>{window, forward});
+  else
+    general_r2c(ain, aout, 1, fct, nthreads, ExecR2C{forward});
+  }
+
+template<typename T> void istft(size_t len, const stride_t &stride_in,
+  ptrdiff_t stride_out, size_t nperseg, size_t hop, const T *window,
+  bool forward, const std::complex<T> *data_in, T *data_out, T fct,
+  size_t nthreads=1)
+  {
+  size_t nframes = stft_frames(len, nperseg, hop);
+  if (stride_in.size()!=2)
+    throw std::runtime_error("stride dimension mismatch");
+  for (size_t i=0; i<len; ++i)
+    *reinterpret_cast<T *>(reinterpret_cast<char *>(data_out)
+      + ptrdiff_t(i)*stride_out) = T(0);
+  if (nframes==0) return;
+  cndarr<cmplx<T>> ain(data_in, {nframes, nperseg/2+1}, stride_in);
+  general_istft(ain, data_out, stride_out, nperseg, hop, window, forward,
+    fct, nthreads);
+  }
+
+template<typename T> void r2c(const shape_t &shape_in,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  bool forward, const T *data_in, std::complex<T> *data_out, T fct,
+  size_t nthreads=1)
+  {
+  if (util::prod(shape_in)==0) return;
+  util::sanity_check(shape_in, stride_in, stride_out, false, axis);
+  cndarr<T> ain(data_in, shape_in, stride_in);
+  shape_t shape_out(shape_in);
+  shape_out[axis] = shape_in[axis]/2 + 1;
+  ndarr<cmplx<T>> aout(data_out, shape_out, stride_out);
+  general_r2c(ain, aout, axis, fct, nthreads, ExecR2C{forward});
+  }
+
+/* writes |X|^2, |X| or log(|X|^2) of the r2c() result X instead of X */
+template<typename T> void r2c(const shape_t &shape_in,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  spectrum mode, const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  if (util::prod(shape_in)==0) return;
+  util::sanity_check(shape_in, stride_in, stride_out, false, axis);
+  cndarr<T> ain(data_in, shape_in, stride_in);
+  shape_t shape_out(shape_in);
+  shape_out[axis] = shape_in[axis]/2 + 1;
+  ndarr<T> aout(data_out, shape_out, stride_out);
+  general_r2c(ain, aout, axis, fct, nthreads, ExecR2CSpectrum{mode});
+  }
+
+template<typename T> void r2c(const shape_t &shape_in,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  bool forward, const T *data_in, std::complex<T> *data_out, T fct,
+  size_t nthreads=1)
+  {
+  if (util::prod(shape_in)==0) return;
+  util::sanity_check(shape_in, stride_in, stride_out, false, axes);
+  r2c(shape_in, stride_in, stride_out, axes.back(), forward, data_in, data_out,
+    fct, nthreads);
+  if (axes.size()==1) return;
+
+  shape_t shape_out(shape_in);
+  shape_out[axes.back()] = shape_in[axes.back()]/2 + 1;
+  auto newaxes = shape_t{axes.begin(), --axes.end()};
+  c2c(shape_out, stride_out, stride_out, newaxes, forward, data_out, data_out,
+    T(1), nthreads);
+  }
+
+template<typename T> void c2r(const shape_t &shape_out,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  bool forward, const std::complex<T> *data_in, T *data_out, T fct,
+  size_t nthreads=1)
+  {
+  if (util::prod(shape_out)==0) return;
+  util::sanity_check(shape_out, stride_in, stride_out, false, axis);
+  shape_t shape_in(shape_out);
+  shape_in[axis] = shape_out[axis]/2 + 1;
+  cndarr<cmplx<T>> ain(data_in, shape_in, stride_in);
+  ndarr<T> aout(data_out, shape_out, stride_out);
+  general_c2r(ain, aout, axis, forward, fct, nthreads);
+  }
+
+template<typename T> void c2r(const shape_t &shape_out,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  bool forward, const std::complex<T> *data_in, T *data_out, T fct,
+  size_t nthreads=1)
+  {
+  if (util::prod(shape_out)==0) return;
+  if (axes.size()==1)
+    return c2r(shape_out, stride_in, stride_out, axes[0], forward,
+      data_in, data_out, fct, nthreads);
+  util::sanity_check(shape_out, stride_in, stride_out, false, axes);
+  auto shape_in = shape_out;
+  shape_in[axes.back()] = shape_out[axes.back()]/2 + 1;
+  auto nval = util::prod(shape_in);
+  stride_t stride_inter(shape_in.size());
+  stride_inter.back() = sizeof(cmplx<T>);
+  for (int i=int(shape_in.size())-2; i>=0; --i)
+    stride_inter[size_t(i)] =
+      stride_inter[size_t(i+1)]*ptrdiff_t(shape_in[size_t(i+1)]);
+  arr<std::complex<T>> tmp(nval);
+  auto newaxes = shape_t{axes.begin(), --axes.end()};
+  c2c(shape_in, stride_in, stride_inter, newaxes, forward, data_in, tmp.data(),
+    T(1), nthreads);
+  c2r(shape_out, stride_inter, stride_out, axes.back(), forward,
+    tmp.data(), data_out, fct, nthreads);
+  }
+
+template<typename T> void r2r_fftpack(const shape_t &shape,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  bool real2hermitian, bool forward, const T *data_in, T *data_out, T fct,
+  size_t nthreads=1)
+  {
+  if (util::prod(shape)==0) return;
+  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
+  cndarr<T> ain(data_in, shape, stride_in);
+  ndarr<T> aout(data_out, shape, stride_out);
+  general_nd<pocketfft_r<T>>(ain, aout, axes, fct, nthreads,
+    ExecR2R{real2hermitian, forward});
+  }
+
+template<typename T> void r2r_separable_hartley(const shape_t &shape,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  if (util::prod(shape)==0) return;
+  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
+  cndarr<T> ain(data_in, shape, stride_in);
+  ndarr<T> aout(data_out, shape, stride_out);
+  general_nd<pocketfft_r<T>>(ain, aout, axes, fct, nthreads, ExecHartley{},
+    false);
+  }
+
+template<typename T> void r2r_genuine_hartley(const shape_t &shape,
+  const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
+  const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  if (util::prod(shape)==0) return;
+  if (axes.size()==1)
+    return r2r_separable_hartley(shape, stride_in, stride_out, axes, data_in,
+      data_out, fct, nthreads);
+  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
+  shape_t tshp(shape);
+  tshp[axes.back()] = tshp[axes.back()]/2+1;
+  arr<std::complex<T>> tdata(util::prod(tshp));
+  stride_t tstride(shape.size());
+  tstride.back()=sizeof(std::complex<T>);
+  for (size_t i=tstride.size()-1; i>0; --i)
+    tstride[i-1]=tstride[i]*ptrdiff_t(tshp[i]);
+  r2c(shape, stride_in, tstride, axes, true, data_in, tdata.data(), fct, nthreads);
+  cndarr<cmplx<T>> atmp(tdata.data(), tshp, tstride);
+  ndarr<T> aout(data_out, shape, stride_out);
+  simple_iter iin(atmp);
+  rev_iter iout(aout, axes);
+  while(iin.remaining()>0)
+    {
+    auto v = atmp[iin.ofs()];
+    aout[iout.ofs()] = v.r+v.i;
+    aout[iout.rev_ofs()] = v.r-v.i;
+    iin.advance(); iout.advance();
     }
-  return arr<char>(tmpsize*elemsize);
   }
 
-template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
-  const cndarr<cmplx<T>> &src, cmplx<vtype_t<T>> *POCKETFFT_RESTRICT dst)
+//
+// reusable plans for multi-D transforms
+//
+
+/* Precomputed state for transforming all lines along one axis of a fixed
+   array layout: the 1D plan, the number of threads, the offsets of all lines
+   (split into contiguous per-thread ranges) and per-thread scratch space.
+   Only the data pointers change between calls to exec(). */
+template<typename T0, typename Tplan, typename Tin, typename Tout,
+  typename Exec> class axis_plan
+  {
+  private:
+    using Tbuf = typename std::conditional<std::is_same<Tin, Tout>::value,
+      Tin, T0>::type;
+
+    cndarr<Tin> ain;
+    ndarr<Tout> aout;
+    size_t axis, nthreads, ninner;
+    std::shared_ptr<Tplan> plan;
+    std::vector<ptrdiff_t> ofs_i, ofs_o;
+    shape_t lo; // thread i handles lines [lo[i]; lo[i+1])
+    std::vector<arr<char>> storage;
+    Exec exec_;
+    bool allow_inplace;
+
+  public:
+    axis_plan(std::shared_ptr<Tplan> plan_, const shape_t &shape_in,
+      const stride_t &stride_in, const shape_t &shape_out,
+      const stride_t &stride_out, size_t axis_, size_t nthreads_,
+      const Exec &exec, bool allow_inplace_)
+      : ain(nullptr, shape_in, stride_in), aout(nullptr, shape_out, stride_out),
+        axis(axis_),
+        nthreads(util::thread_count(nthreads_, shape_in, axis_,
+          VLEN<Tbuf>::val)),
+        ninner(util::inner_thread_count(nthreads_, nthreads)),
+        plan(plan_), exec_(exec), allow_inplace(allow_inplace_)
+      {
+      multi_iter<1> it(ain, aout, axis);
+      ofs_i.reserve(it.remaining());
+      ofs_o.reserve(it.remaining());
+      while (it.remaining()>0)
+        {
+        it.advance(1);
+        ofs_i.push_back(it.iofs(0));
+        ofs_o.push_back(it.oofs(0));
+        }
+      size_t nlines = ofs_i.size(),
+             nbase = nlines/nthreads,
+             additional = nlines%nthreads;
+      lo.resize(nthreads+1);
+      for (size_t i=0; i<=nthreads; ++i)
+        lo[i] = i*nbase + std::min(i, additional);
+      const auto &rshape(std::is_same<Tbuf, Tin>::value ? shape_in : shape_out);
+      for (size_t i=0; i<nthreads; ++i)
+        storage.push_back(alloc_tmp<T0>(rshape, plan->length(), sizeof(Tbuf),
+          plan->workspace_size()));
+      }
+
+    void exec(const Tin *in, Tout *out, T0 fct)
+      { exec(in, out, fct, exec_); }
+    /* the same with another functor of the same type, for functors carrying
+       per-call parameters */
+    void exec(const Tin *in, Tout *out, T0 fct, const Exec &exec)
+      {
+      ain.set_data(in);
+      aout.set_data(out);
+      threading::thread_map(nthreads, [&] {
+        constexpr auto vlen = VLEN<T0>::val;
+        size_t ithr = threading::thread_id();
+        multi_iter<vlen> it(ain, aout, axis, ofs_i.data()+lo[ithr],
+          ofs_o.data()+lo[ithr], lo[ithr+1]-lo[ithr]);
+        exec_lines<Tbuf>(it, ain, aout, storage[ithr].data(), *plan, fct,
+          exec, allow_inplace, ninner);
+        });  // end of parallel region
+      }
+  };
+
+/* Plan equivalent of general_nd(). */
+template<typename T0, typename Tplan, typename T, typename Exec> class nd_plan
+  {
+  private:
+    std::vector<axis_plan<T0, Tplan, T, T, Exec>> passes;
+    bool same_strides;
+
+  public:
+    nd_plan(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, size_t nthreads,
+      const Exec &exec, bool allow_inplace=true)
+      : same_strides(stride_in==stride_out)
+      {
+      if (util::prod(shape)==0) return;
+      util::sanity_check(shape, stride_in, stride_out, false, axes);
+      std::shared_ptr<Tplan> plan;
+      for (size_t iax=0; iax<axes.size(); ++iax)
+        {
+        size_t len=shape[axes[iax]];
+        if ((!plan) || (len!=plan->length()))
+          plan = get_plan<Tplan>(len);
+        passes.emplace_back(plan, shape, (iax==0) ? stride_in : stride_out,
+          shape, stride_out, axes[iax], nthreads, exec, allow_inplace);
+        }
+      }
+
+    void exec(const T *in, T *out, T0 fct)
+      {
+      if (passes.empty()) return;
+      if ((in==out) && (!same_strides))
+        throw std::runtime_error("stride mismatch");
+      for (size_t iax=0; iax<passes.size(); ++iax)
+        {
+        passes[iax].exec((iax==0) ? in : out, out, fct);
+        fct = T0(1); // factor has been applied, use 1 for remaining axes
+        }
+      }
+  };
+
+template<typename T> class plan_c2c
+  {
+  private:
+    nd_plan<T, pocketfft_c<T>, cmplx<T>, ExecC2C> plan;
+
+  public:
+    plan_c2c(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool forward,
+      size_t nthreads=1)
+      : plan(shape, stride_in, stride_out, axes, nthreads, ExecC2C{forward}) {}
+
+    void exec(const std::complex<T> *data_in, std::complex<T> *data_out,
+      T fct)
+      {
+      plan.exec(reinterpret_cast<const cmplx<T> *>(data_in),
+        reinterpret_cast<cmplx<T> *>(data_out), fct);
+      }
+  };
+
+template<typename T> class plan_r2c
+  {
+  private:
+    using rpass_t = axis_plan<T, pocketfft_r<T>, T, cmplx<T>, ExecR2C>;
+    using cpass_t = nd_plan<T, pocketfft_c<T>, cmplx<T>, ExecC2C>;
+    std::unique_ptr<rpass_t> rpass;
+    std::unique_ptr<cpass_t> cpass;
+
+  public:
+    plan_r2c(const shape_t &shape_in, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool forward,
+      size_t nthreads=1)
+      {
+      if (util::prod(shape_in)==0) return;
+      util::sanity_check(shape_in, stride_in, stride_out, false, axes);
+      size_t axis = axes.back();
+      shape_t shape_out(shape_in);
+      shape_out[axis] = shape_in[axis]/2 + 1;
+      rpass.reset(new rpass_t(get_plan<pocketfft_r<T>>(shape_in[axis]),
+        shape_in, stride_in, shape_out, stride_out, axis, nthreads,
+        ExecR2C{forward}, false));
+      if (axes.size()==1) return;
+      cpass.reset(new cpass_t(shape_out, stride_out, stride_out,
+        shape_t{axes.begin(), --axes.end()}, nthreads, ExecC2C{forward}));
+      }
+    plan_r2c(const shape_t &shape_in, const stride_t &stride_in,
+      const stride_t &stride_out, size_t axis, bool forward,
+      size_t nthreads=1)
+      : plan_r2c(shape_in, stride_in, stride_out, shape_t{axis}, forward,
+          nthreads) {}
+
+    void exec(const T *data_in, std::complex<T> *data_out, T fct)
+      {
+      if (!rpass) return;
+      auto out = reinterpret_cast<cmplx<T> *>(data_out);
+      rpass->exec(data_in, out, fct);
+      if (cpass) cpass->exec(out, out, T(1));
+      }
+  };
+
+template<typename T> class plan_c2r
+  {
+  private:
+    using cpass_t = nd_plan<T, pocketfft_c<T>, cmplx<T>, ExecC2C>;
+    using rpass_t = axis_plan<T, pocketfft_r<T>, cmplx<T>, T, ExecC2R>;
+    std::unique_ptr<cpass_t> cpass;
+    std::unique_ptr<rpass_t> rpass;
+    arr<cmplx<T>> tmp;
+
+  public:
+    plan_c2r(const shape_t &shape_out, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool forward,
+      size_t nthreads=1)
+      {
+      if (util::prod(shape_out)==0) return;
+      util::sanity_check(shape_out, stride_in, stride_out, false, axes);
+      size_t axis = axes.back();
+      shape_t shape_in(shape_out);
+      shape_in[axis] = shape_out[axis]/2 + 1;
+      auto plan = get_plan<pocketfft_r<T>>(shape_out[axis]);
+      if (axes.size()==1)
+        {
+        rpass.reset(new rpass_t(plan, shape_in, stride_in, shape_out,
+          stride_out, axis, nthreads, ExecC2R{forward}, false));
+        return;
+        }
+      stride_t stride_inter(shape_in.size());
+      stride_inter.back() = sizeof(cmplx<T>);
+      for (int i=int(shape_in.size())-2; i>=0; --i)
+        stride_inter[size_t(i)] =
+          stride_inter[size_t(i+1)]*ptrdiff_t(shape_in[size_t(i+1)]);
+      tmp.resize(util::prod(shape_in));
+      cpass.reset(new cpass_t(shape_in, stride_in, stride_inter,
+        shape_t{axes.begin(), --axes.end()}, nthreads, ExecC2C{forward}));
+      rpass.reset(new rpass_t(plan, shape_in, stride_inter, shape_out,
+        stride_out, axis, nthreads, ExecC2R{forward}, false));
+      }
+    plan_c2r(const shape_t &shape_out, const stride_t &stride_in,
+      const stride_t &stride_out, size_t axis, bool forward,
+      size_t nthreads=1)
+      : plan_c2r(shape_out, stride_in, stride_out, shape_t{axis}, forward,
+          nthreads) {}
+
+    void exec(const std::complex<T> *data_in, T *data_out, T fct)
+      {
+      if (!rpass) return;
+      auto in = reinterpret_cast<const cmplx<T> *>(data_in);
+      if (!cpass)
+        { rpass->exec(in, data_out, fct); return; }
+      cpass->exec(in, tmp.data(), T(1));
+      rpass->exec(tmp.data(), data_out, fct);
+      }
+  };
+
+template<typename T> class plan_r2r_fftpack
+  {
+  private:
+    nd_plan<T, pocketfft_r<T>, T, ExecR2R> plan;
+
+  public:
+    plan_r2r_fftpack(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool real2hermitian,
+      bool forward, size_t nthreads=1)
+      : plan(shape, stride_in, stride_out, axes, nthreads,
+          ExecR2R{real2hermitian, forward}) {}
+
+    void exec(const T *data_in, T *data_out, T fct)
+      { plan.exec(data_in, data_out, fct); }
+  };
+
+template<typename T0, typename Tplan1, bool cosine> class plan_dcst
   {
-  for (size_t i=0; i<it.length_in(); ++i)
-    for (size_t j=0; j<vlen; ++j)
+  private:
+    std::unique_ptr<nd_plan<T0, Tplan1, T0, ExecDcst>> plan1;
+    std::unique_ptr<nd_plan<T0, T_dcst23<T0>, T0, ExecDcst>> plan23;
+    std::unique_ptr<nd_plan<T0, T_dcst4<T0>, T0, ExecDcst>> plan4;
+
+  public:
+    plan_dcst(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, int type, bool ortho,
+      size_t nthreads=1)
       {
-      dst[i].r[j] = src[it.iofs(j,i)].r;
-      dst[i].i[j] = src[it.iofs(j,i)].i;
+      if ((type<1) || (type>4))
+        throw std::invalid_argument(cosine ? "invalid DCT type"
+                                           : "invalid DST type");
+      const ExecDcst exec{ortho, type, cosine};
+      if (type==1)
+        plan1.reset(new nd_plan<T0, Tplan1, T0, ExecDcst>
+          (shape, stride_in, stride_out, axes, nthreads, exec));
+      else if (type==4)
+        plan4.reset(new nd_plan<T0, T_dcst4<T0>, T0, ExecDcst>
+          (shape, stride_in, stride_out, axes, nthreads, exec));
+      else
+        plan23.reset(new nd_plan<T0, T_dcst23<T0>, T0, ExecDcst>
+          (shape, stride_in, stride_out, axes, nthreads, exec));
       }
-  }
 
-template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
-  const cndarr<T> &src, vtype_t<T> *POCKETFFT_RESTRICT dst)
-  {
-  for (size_t i=0; i<it.length_in(); ++i)
-    for (size_t j=0; j<vlen; ++j)
-      dst[i][j] = src[it.iofs(j,i)];
-  }
+    void exec(const T0 *data_in, T0 *data_out, T0 fct)
+      {
+      if (plan1) plan1->exec(data_in, data_out, fct);
+      else if (plan4) plan4->exec(data_in, data_out, fct);
+      else plan23->exec(data_in, data_out, fct);
+      }
+  };
 
-template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
-  const cndarr<T> &src, T *POCKETFFT_RESTRICT dst)
-  {
-  if (dst == &src[it.iofs(0)]) return;  // in-place
-  for (size_t i=0; i<it.length_in(); ++i)
-    dst[i] = src[it.iofs(i)];
-  }
+template<typename T> using plan_dct = plan_dcst<T, T_dct1<T>, true>;
+template<typename T> using plan_dst = plan_dcst<T, T_dst1<T>, false>;
 
-template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
-  const cmplx<vtype_t<T>> *POCKETFFT_RESTRICT src, ndarr<cmplx<T>> &dst)
+//
+// streaming FIR filtering
+//
+
+/* multiplies the halfcomplex array buf by the halfcomplex array spec */
+template<typename T, typename T0> void mul_halfcomplex(T *buf,
+  const T0 *spec, size_t len)
   {
-  for (size_t i=0; i<it.length_out(); ++i)
-    for (size_t j=0; j<vlen; ++j)
-      dst[it.oofs(j,i)].Set(src[i].r[j],src[i].i[j]);
+  buf[0] *= spec[0];
+  size_t i=1;
+  for (; i<len-1; i+=2)
+    {
+    T re = buf[i]*spec[i] - buf[i+1]*spec[i+1];
+    T im = buf[i]*spec[i+1] + buf[i+1]*spec[i];
+    buf[i] = re;
+    buf[i+1] = im;
+    }
+  if (i<len)
+    buf[i] *= spec[i];
   }
 
-template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
-  const vtype_t<T> *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+/* copies src[0..n) to the first n entries of the output line(s) */
+template<typename T, size_t vlen> void copy_output_head(
+  const multi_iter<vlen> &it, const vtype_t<T> *POCKETFFT_RESTRICT src,
+  size_t n, ndarr<T> &dst)
   {
-  for (size_t i=0; i<it.length_out(); ++i)
+  for (size_t i=0; i<n; ++i)
     for (size_t j=0; j<vlen; ++j)
       dst[it.oofs(j,i)] = src[i][j];
   }
 
-template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
-  const T *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+template<typename T, size_t vlen> void copy_output_head(
+  const multi_iter<vlen> &it, const T *POCKETFFT_RESTRICT src, size_t n,
+  ndarr<T> &dst)
   {
-  if (src == &dst[it.oofs(0)]) return;  // in-place
-  for (size_t i=0; i<it.length_out(); ++i)
+  for (size_t i=0; i<n; ++i)
     dst[it.oofs(i)] = src[i];
   }
 
-template <typename T> struct add_vec { using type = vtype_t<T>; };
-template <typename T> struct add_vec<cmplx<T>>
-  { using type = cmplx<vtype_t<T>>; };
-template <typename T> using add_vec_t = typename add_vec<T>::type;
-
-template<typename Tplan, typename T, typename T0, typename Exec>
-POCKETFFT_NOINLINE void general_nd(const cndarr<T> &in, ndarr<T> &out,
-  const shape_t &axes, T0 fct, size_t nthreads, const Exec & exec,
-  const bool allow_inplace=true)
+/* One overlap-save step: circular convolution of every input line with the
+   filter (given by its normalized halfcomplex spectrum), of which the `nout`
+   values starting at `ofs` are written to the output line. */
+template<typename T0> struct ExecFir
   {
-  std::shared_ptr<Tplan> plan;
+  const T0 *spec;
+  size_t ofs, nout;
 
-  for (size_t iax=0; iax<axes.size(); ++iax)
+  template <typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 /*fct*/,
+    size_t nthreads) const
     {
-    size_t len=in.shape(axes[iax]);
-    if ((!plan) || (len!=plan->length()))
-      plan = get_plan<Tplan>(len);
+    copy_input(it, in, buf);
+    plan.exec(buf, T0(1), true, scratch, nthreads);
+    mul_halfcomplex(buf, spec, it.length_in());
+    plan.exec(buf, T0(1), false, scratch, nthreads);
+    copy_output_head(it, buf+ofs, nout, out);
+    }
+  };
 
-    threading::thread_map(
-      util::thread_count(nthreads, in.shape(), axes[iax], VLEN<T>::val),
-      [&] {
-        constexpr auto vlen = VLEN<T0>::val;
-        auto storage = alloc_tmp<T0>(in.shape(), len, sizeof(T));
-        const auto &tin(iax==0? in : out);
-        multi_iter<vlen> it(tin, out, axes[iax]);
-#ifndef POCKETFFT_NO_VECTORS
-        if (vlen>1)
-          while (it.remaining()>=vlen)
-            {
-            it.advance(vlen);
-            auto tdatav = reinterpret_cast<add_vec_t<T> *>(storage.data());
-            exec(it, tin, out, tdatav, *plan, fct);
-            }
-#endif
-        while (it.remaining()>0)
+/* Streaming convolution of one or more channels with an FIR filter by the
+   overlap-save method. The input arrives in chunks of arbitrary size; the
+   last ntaps-1 input samples of every channel are kept between calls, so
+   the concatenated outputs equal the convolution of the concatenated inputs
+   (truncated to the input length), without any latency.
+   Each chunk is processed in steps of at most step_size() samples, each of
+   which costs one real FFT pair of length fft_length() per channel; the
+   channels are transformed together in groups of the SIMD vector length.
+   All buffers are allocated by the constructor. */
+template<typename T> class fir_filter
+  {
+  private:
+    using pass_t = axis_plan<T, pocketfft_r<T>, T, T, ExecFir<T>>;
+
+    size_t ntaps, nchan, len, step;
+    stride_t str_in, str_out;
+    arr<T> spec, frames;
+    std::unique_ptr<pass_t> pass;
+
+    /* FFT length minimizing the estimated cost per output sample */
+    static size_t choose_length(size_t ntaps)
+      {
+      size_t best=0;
+      double bestcost=0;
+      for (size_t l=1; l<=std::max<size_t>(64*ntaps, 4096); l*=2)
+        {
+        size_t n = util::good_size_real(ntaps-1+l);
+        double cost = util::cost_guess(n)/double(n-ntaps+1);
+        if ((best==0) || (cost<bestcost))
+          { best=n; bestcost=cost; }
+        }
+      return best;
+      }
+
+  public:
+    /* stride_in and stride_out contain the distances (in bytes) between
+       channels and between consecutive samples of a channel. If block is
+       nonzero, the FFT length is the smallest good length for steps of at
+       least `block` samples. */
+    fir_filter(const T *taps, size_t ntaps_, size_t nchannels,
+      const stride_t &stride_in, const stride_t &stride_out,
+      size_t nthreads=1, size_t block=0)
+      : ntaps(ntaps_), nchan(nchannels), str_in(stride_in),
+        str_out(stride_out)
+      {
+      if ((ntaps==0) || (nchan==0))
+        throw std::invalid_argument("need at least one tap and channel");
+      if ((str_in.size()!=2) || (str_out.size()!=2))
+        throw std::runtime_error("stride dimension mismatch");
+      len = (block==0) ? choose_length(ntaps)
+                       : util::good_size_real(ntaps-1+block);
+      step = len-ntaps+1;
+      auto plan = get_plan<pocketfft_r<T>>(len);
+      spec.resize(len);
+      for (size_t i=0; i<len; ++i)
+        spec[i] = (i<ntaps) ? taps[i] : T(0);
+      plan->exec(spec.data(), T(1)/T(len), true);
+      frames.resize(nchan*len);
+      reset();
+      pass.reset(new pass_t(plan, {nchan, len},
+        {ptrdiff_t(len*sizeof(T)), ptrdiff_t(sizeof(T))}, {nchan, step},
+        {str_out[0], str_out[1]}, 1, nthreads, ExecFir<T>{spec.data(), 0, 0},
+        false));
+      }
+    /* single channel with contiguous input and output */
+    fir_filter(const T *taps, size_t ntaps_, size_t block=0)
+      : fir_filter(taps, ntaps_, 1, {0, sizeof(T)}, {0, sizeof(T)}, 1,
+          block) {}
+
+    /* filters the next n samples of every channel */
+    void exec(const T *data_in, T *data_out, size_t n)
+      {
+      auto in = reinterpret_cast<const char *>(data_in);
+      auto out = reinterpret_cast<char *>(data_out);
+      size_t hist = ntaps-1;
+      for (size_t pos=0; pos<n; pos+=step)
+        {
+        size_t s = std::min(step, n-pos);
+        for (size_t c=0; c<nchan; ++c)
           {
-          it.advance(1);
-          auto buf = allow_inplace && it.stride_out() == sizeof(T) ?
-            &out[it.oofs(0)] : reinterpret_cast<T *>(storage.data());
-          exec(it, tin, out, buf, *plan, fct);
+          T *f = frames.data() + c*len;
+          auto src = in + ptrdiff_t(c)*str_in[0] + ptrdiff_t(pos)*str_in[1];
+          for (size_t i=0; i<s; ++i, src+=str_in[1])
+            f[hist+i] = *reinterpret_cast<const T *>(src);
+          for (size_t i=hist+s; i<len; ++i)
+            f[i] = T(0);
           }
-      });  // end of parallel region
-    fct = T0(1); // factor has been applied, use 1 for remaining axes
+        pass->exec(frames.data(),
+          reinterpret_cast<T *>(out+ptrdiff_t(pos)*str_out[1]), T(1),
+          ExecFir<T>{spec.data(), hist, s});
+        for (size_t c=0; c<nchan; ++c)
+          {
+          T *f = frames.data() + c*len;
+          for (size_t i=0; i<hist; ++i)
+            f[i] = f[i+s];
+          }
+        }
+      }
+
+    /* forgets the input history, as if the stream started anew */
+    void reset()
+      {
+      for (size_t i=0; i<frames.size(); ++i)
+        frames[i] = T(0);
+      }
+
+    size_t fft_length() const { return len; }
+    size_t step_size() const { return step; }
+  };
+
+/* acc += x*h for complex arrays of length n with separate real and imaginary
+   parts */
+template<typename U> void cmac_split(U *POCKETFFT_RESTRICT accr,
+  U *POCKETFFT_RESTRICT acci, const U *POCKETFFT_RESTRICT xr,
+  const U *POCKETFFT_RESTRICT xi, const U *POCKETFFT_RESTRICT hr,
+  const U *POCKETFFT_RESTRICT hi, size_t n)
+  {
+  for (size_t i=0; i<n; ++i)
+    {
+    accr[i] += xr[i]*hr[i] - xi[i]*hi[i];
+    acci[i] += xr[i]*hi[i] + xi[i]*hr[i];
     }
   }
 
-struct ExecC2C
+/* The same for "split spectra" of nb bins (nb real parts followed by nb
+   imaginary parts); with vector support, nb must be a multiple of the
+   vector length and the arrays aligned accordingly. */
+template<typename T> void spectrum_mac(T *acc, const T *x, const T *h,
+  size_t nb, std::false_type)
+  { cmac_split(acc, acc+nb, x, x+nb, h, h+nb, nb); }
+template<typename T> void spectrum_mac(T *acc, const T *x, const T *h,
+  size_t nb, std::true_type)
   {
-  bool forward;
+  using V = vtype_t<T>;
+  constexpr size_t vlen = VLEN<T>::val;
+  auto v = [](const T *p) { return reinterpret_cast<const V *>(p); };
+  cmac_split(reinterpret_cast<V *>(acc), reinterpret_cast<V *>(acc+nb),
+    v(x), v(x+nb), v(h), v(h+nb), nb/vlen);
+  }
+template<typename T> void spectrum_mac(T *acc, const T *x, const T *h,
+  size_t nb)
+  {
+  spectrum_mac(acc, x, h, nb,
+    std::integral_constant<bool, (VLEN<T>::val>1)>());
+  }
 
-  template <typename T0, typename T, size_t vlen> void operator () (
-    const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in,
-    ndarr<cmplx<T0>> &out, T * buf, const pocketfft_c<T0> &plan, T0 fct) const
-    {
-    copy_input(it, in, buf);
-    plan.exec(buf, fct, forward);
-    copy_output(it, buf, out);
-    }
+/* Streaming convolution of a signal with a long FIR filter using partitioned
+   overlap-save. The filter is cut into partitions of `block` taps; every
+   input block is transformed once (real FFT of length 2*block), its
+   spectrum is kept in a frequency-domain delay line, and each output block
+   is obtained from the products of the delayed input spectra with the
+   partition spectra, summed by a vectorized multiply-accumulate kernel, and
+   one inverse FFT.
+   If max_block>block, partitions grow along the filter (non-uniform
+   partitioning): the first 4*block taps use partitions of `block` taps,
+   followed by two partitions each of 2*block, 4*block, ... taps, and the
+   rest of the filter uses the largest size not exceeding max_block. A level
+   with partitions of b taps starts at tap 2*b or later, so its contribution
+   to the next b output samples only depends on complete input blocks and
+   is computed once every b samples.
+   Chunks of any size are accepted and the output is returned without
+   latency; a chunk ending inside a block costs one extra FFT pair of length
+   2*block, so chunks which are multiples of `block` are most efficient. */
+template<typename T> class partitioned_fir_filter
+  {
+  private:
+    /* partitions p0...p0+np-1 of size bs, i.e. taps [p0*bs; (p0+np)*bs) */
+    struct level
+      {
+      size_t bs, p0, np, nb, fill, head;
+      std::shared_ptr<pocketfft_r<T>> plan;
+      arr<T> frame,  // previous and current input block
+             spec,   // np split spectra of the partitions
+             fdl,    // p0+np input block spectra (one of them in progress)
+             acc,    // level 0: sum over the complete input blocks
+             out;    // other levels: their contribution to the current block
+
+      level(const T *taps, size_t ntaps, size_t bs_, size_t p0_, size_t np_,
+        T *buf)
+        : bs(bs_), p0(p0_), np(np_),
+          nb(((bs+1+VLEN<T>::val-1)/VLEN<T>::val)*VLEN<T>::val),
+          fill(0), head(0), plan(get_plan<pocketfft_r<T>>(2*bs)),
+          frame(2*bs), spec(np*2*nb), fdl((p0+np)*2*nb),
+          acc((p0==0) ? 2*nb : 0), out((p0==0) ? 0 : bs)
+        {
+        for (size_t p=0; p<np; ++p)
+          {
+          for (size_t i=0; i<2*bs; ++i)
+            {
+            size_t j = (p0+p)*bs+i;
+            buf[i] = ((i<bs) && (j<ntaps)) ? taps[j] : T(0);
+            }
+          plan->exec(buf, T(1)/T(2*bs), true);
+          to_split(buf, &spec[p*2*nb]);
+          }
+        }
+
+      void to_split(const T *hc, T *sp) const
+        {
+        size_t n=2*bs;
+        sp[0] = hc[0]; sp[nb] = T(0);
+        for (size_t k=1; k<bs; ++k)
+          { sp[k] = hc[2*k-1]; sp[nb+k] = hc[2*k]; }
+        sp[bs] = hc[n-1]; sp[nb+bs] = T(0);
+        for (size_t k=bs+1; k<nb; ++k)
+          sp[k] = sp[nb+k] = T(0);
+        }
+      void from_split(const T *sp, T *hc) const
+        {
+        size_t n=2*bs;
+        hc[0] = sp[0];
+        for (size_t k=1; k<bs; ++k)
+          { hc[2*k-1] = sp[k]; hc[2*k] = sp[nb+k]; }
+        hc[n-1] = sp[bs];
+        }
+      size_t nslots() const { return p0+np; }
+      T *slot(size_t i) { return &fdl[(i%nslots())*2*nb]; }
+      /* spectrum of the block which is being filled */
+      T *current() { return slot(head+1); }
+      /* input spectrum delayed by p blocks relative to the current one */
+      const T *delayed(size_t p) { return slot(head+nslots()+1-p); }
+
+      /* products with all partitions, except for the one with index 0 */
+      void accumulate(T *res)
+        {
+        for (size_t i=0; i<2*nb; ++i)
+          res[i] = T(0);
+        for (size_t p=std::max<size_t>(p0, 1); p<p0+np; ++p)
+          spectrum_mac(res, delayed(p), &spec[(p-p0)*2*nb], nb);
+        }
+
+      void reset()
+        {
+        fill = head = 0;
+        for (size_t i=0; i<frame.size(); ++i) frame[i] = T(0);
+        for (size_t i=0; i<fdl.size(); ++i) fdl[i] = T(0);
+        for (size_t i=0; i<acc.size(); ++i) acc[i] = T(0);
+        for (size_t i=0; i<out.size(); ++i) out[i] = T(0);
+        }
+      };
+
+    std::vector<level> levels;
+    arr<T> hc, tmp, work;
+
+    void transform(level &l, T *sp)
+      {
+      l.plan->exec(l.frame.data(), hc.data(), T(1), true, work.data());
+      l.to_split(hc.data(), sp);
+      }
+    void inverse(level &l, const T *sp)
+      {
+      l.from_split(sp, hc.data());
+      l.plan->exec(hc.data(), T(1), false, work.data());
+      }
+    /* called when the current block of level l is complete */
+    void finish_block(level &l)
+      {
+      if (&l!=&levels[0])
+        transform(l, l.current());
+      l.head = (l.head+1)%l.nslots();
+      if (l.p0==0)
+        l.accumulate(l.acc.data());
+      else
+        {
+        l.accumulate(tmp.data());
+        inverse(l, tmp.data());
+        for (size_t i=0; i<l.bs; ++i)
+          l.out[i] = hc[l.bs+i];
+        }
+      for (size_t i=0; i<l.bs; ++i)
+        {
+        l.frame[i] = l.frame[l.bs+i];
+        l.frame[l.bs+i] = T(0);
+        }
+      l.fill = 0;
+      }
+
+  public:
+    partitioned_fir_filter(const T *taps, size_t ntaps, size_t block,
+      size_t max_block=0)
+      {
+      if ((ntaps==0) || (block==0))
+        throw std::invalid_argument("need at least one tap and sample");
+      size_t maxbs = block;
+      if (max_block>block)
+        while (maxbs*2<=max_block) maxbs*=2;
+      size_t nbmax = ((maxbs+1+VLEN<T>::val-1)/VLEN<T>::val)*VLEN<T>::val;
+      hc.resize(2*maxbs);
+      tmp.resize(2*nbmax);
+      size_t bs = block, start = 0;
+      while (start<ntaps)
+        {
+        size_t p0 = start/bs, np = (ntaps-start+bs-1)/bs;
+        if (bs<maxbs)
+          np = std::min(np, size_t((start==0) ? 4 : 2));
+        levels.emplace_back(taps, ntaps, bs, p0, np, hc.data());
+        start = (p0+np)*bs;
+        bs = std::min(2*bs, maxbs);
+        }
+      size_t wsz = 0;
+      for (const auto &l: levels)
+        wsz = std::max(wsz, l.plan->workspace_size());
+      work.resize(wsz);
+      reset();
+      }
+
+    /* filters the next n samples */
+    void exec(const T *data_in, T *data_out, size_t n)
+      {
+      auto &l0(levels[0]);
+      size_t bs = l0.bs;
+      for (size_t pos=0; pos<n; )
+        {
+        size_t s = std::min(bs-l0.fill, n-pos);
+        for (auto &l: levels)
+          std::copy_n(data_in+pos, s, &l.frame[l.bs+l.fill]);
+        transform(l0, l0.current());
+        for (size_t i=0; i<2*l0.nb; ++i)
+          tmp[i] = l0.acc[i];
+        spectrum_mac(tmp.data(), l0.current(), l0.spec.data(), l0.nb);
+        inverse(l0, tmp.data());
+        for (size_t i=0; i<s; ++i)
+          data_out[pos+i] = hc[bs+l0.fill+i];
+        for (size_t il=1; il<levels.size(); ++il)
+          for (size_t i=0; i<s; ++i)
+            data_out[pos+i] += levels[il].out[levels[il].fill+i];
+        for (auto &l: levels)
+          if ((l.fill+=s)==l.bs)
+            finish_block(l);
+        pos += s;
+        }
+      }
+
+    /* forgets the input history, as if the stream started anew */
+    void reset()
+      {
+      for (auto &l: levels)
+        l.reset();
+      }
+
+    size_t block_size() const { return levels[0].bs; }
   };
 
-template <typename T, size_t vlen> void copy_hartley(const multi_iter<vlen> &it,
-  const vtype_t<T> *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+//
+// FFT-based convolution and correlation
+//
+
+/* multiplies the complex line(s) in buf by the spectrum values of `kern`
+   at the same offsets */
+template<typename T, size_t vlen> void mul_kernel_line(
+  const multi_iter<vlen> &it, const cndarr<cmplx<T>> &kern,
+  cmplx<vtype_t<T>> *POCKETFFT_RESTRICT buf)
   {
-  for (size_t j=0; j<vlen; ++j)
-    dst[it.oofs(j,0)] = src[0][j];
-  size_t i=1, i1=1, i2=it.length_out()-1;
-  for (i=1; i<it.length_out()-1; i+=2, ++i1, --i2)
+  for (size_t i=0; i<it.length_in(); ++i)
     for (size_t j=0; j<vlen; ++j)
       {
-        dst[it.oofs(j,i1)] = src[i][j]+src[i+1][j];
-        dst[it.oofs(j,i2)] = src[i][j]-src[i+1][j];
+      auto k = kern[it.iofs(j,i)];
+      auto re = buf[i].r[j], im = buf[i].i[j];
+      buf[i].r[j] = re*k.r - im*k.i;
+      buf[i].i[j] = re*k.i + im*k.r;
       }
-  if (i<it.length_out())
-    for (size_t j=0; j<vlen; ++j)
-      dst[it.oofs(j,i1)] = src[i][j];
   }
 
-template <typename T, size_t vlen> void copy_hartley(const multi_iter<vlen> &it,
-  const T *POCKETFFT_RESTRICT src, ndarr<T> &dst)
+template<typename T, size_t vlen> void mul_kernel_line(
+  const multi_iter<vlen> &it, const cndarr<cmplx<T>> &kern,
+  cmplx<T> *POCKETFFT_RESTRICT buf)
   {
-  dst[it.oofs(0)] = src[0];
-  size_t i=1, i1=1, i2=it.length_out()-1;
-  for (i=1; i<it.length_out()-1; i+=2, ++i1, --i2)
-    {
-    dst[it.oofs(i1)] = src[i]+src[i+1];
-    dst[it.oofs(i2)] = src[i]-src[i+1];
-    }
-  if (i<it.length_out())
-    dst[it.oofs(i1)] = src[i];
+  for (size_t i=0; i<it.length_in(); ++i)
+    buf[i] *= kern[it.iofs(i)];
   }
 
-struct ExecHartley
+/* r2c of zero-padded input lines */
+struct ExecR2CPadded
   {
   template <typename T0, typename T, size_t vlen> void operator () (
-    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
-    T * buf, const pocketfft_r<T0> &plan, T0 fct) const
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<cmplx<T0>> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
     {
     copy_input(it, in, buf);
-    plan.exec(buf, fct, true);
-    copy_hartley(it, buf, out);
+    for (size_t i=it.length_in(); i<plan.length(); ++i)
+      buf[i] = T();
+    plan.exec(buf, fct, true, scratch, nthreads);
+    copy_output_r2c(it, buf, out, true, plan.length());
     }
   };
 
-struct ExecDcst
+/* c2r, of which only the values starting at `start` are written */
+struct ExecC2RCrop
   {
-  bool ortho;
-  int type;
-  bool cosine;
+  size_t start;
 
-  template <typename T0, typename T, typename Tplan, size_t vlen>
-  void operator () (const multi_iter<vlen> &it, const cndarr<T0> &in,
-    ndarr<T0> &out, T * buf, const Tplan &plan, T0 fct) const
+  template <typename T0, typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input_c2r(it, in, buf, false, plan.length());
+    plan.exec(buf, fct, false, scratch, nthreads);
+    copy_output_head(it, buf+start, it.length_out(), out);
+    }
+  };
+
+/* forward c2c, product with the kernel spectrum and backward c2c along the
+   same lines */
+template<typename T0> struct ExecConvC2C
+  {
+  const cndarr<cmplx<T0>> *kern;
+
+  template <typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in,
+    ndarr<cmplx<T0>> &out, T * buf, T * scratch, const pocketfft_c<T0> &plan,
+    T0 fct, size_t nthreads) const
     {
     copy_input(it, in, buf);
-    plan.exec(buf, fct, ortho, type, cosine);
+    plan.exec(buf, T0(1), true, scratch, nthreads);
+    mul_kernel_line(it, *kern, buf);
+    plan.exec(buf, fct, false, scratch, nthreads);
     copy_output(it, buf, out);
     }
   };
 
-template<typename T> POCKETFFT_NOINLINE void general_r2c(
-  const cndarr<T> &in, ndarr<cmplx<T>> &out, size_t axis, bool forward, T fct,
-  size_t nthreads)
+/* the complete 1D convolution: zero padding, r2c, product with the
+   halfcomplex kernel spectrum, c2r and cropping */
+template<typename T0> struct ExecConvR2R
   {
-  auto plan = get_plan<pocketfft_r<T>>(in.shape(axis));
-  size_t len=in.shape(axis);
-  threading::thread_map(
-    util::thread_count(nthreads, in.shape(), axis, VLEN<T>::val),
-    [&] {
-    constexpr auto vlen = VLEN<T>::val;
-    auto storage = alloc_tmp<T>(in.shape(), len, sizeof(T));
-    multi_iter<vlen> it(in, out, axis);
-#ifndef POCKETFFT_NO_VECTORS
-    if (vlen>1)
-      while (it.remaining()>=vlen)
-        {
-        it.advance(vlen);
-        auto tdatav = reinterpret_cast<vtype_t<T> *>(storage.data());
-        copy_input(it, in, tdatav);
-        plan->exec(tdatav, fct, true);
-        for (size_t j=0; j<vlen; ++j)
-          out[it.oofs(j,0)].Set(tdatav[0][j]);
-        size_t i=1, ii=1;
-        if (forward)
-          for (; i<len-1; i+=2, ++ii)
-            for (size_t j=0; j<vlen; ++j)
-              out[it.oofs(j,ii)].Set(tdatav[i][j], tdatav[i+1][j]);
-        else
-          for (; i<len-1; i+=2, ++ii)
-            for (size_t j=0; j<vlen; ++j)
-              out[it.oofs(j,ii)].Set(tdatav[i][j], -tdatav[i+1][j]);
-        if (i<len)
-          for (size_t j=0; j<vlen; ++j)
-            out[it.oofs(j,ii)].Set(tdatav[i][j]);
+  const T0 *kern;
+  size_t start;
+
+  template <typename T, size_t vlen> void operator () (
+    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct,
+    size_t nthreads) const
+    {
+    copy_input(it, in, buf);
+    for (size_t i=it.length_in(); i<plan.length(); ++i)
+      buf[i] = T();
+    plan.exec(buf, T0(1), true, scratch, nthreads);
+    mul_halfcomplex(buf, kern, plan.length());
+    plan.exec(buf, fct, false, scratch, nthreads);
+    copy_output_head(it, buf+start, it.length_out(), out);
+    }
+  };
+
+/* Convolution (or correlation) of arrays of shape shape_in with a fixed
+   kernel via FFTs of zero-padded arrays. The padded lengths are the
+   smallest good FFT lengths for which the requested output region is not
+   affected by the cyclic wrap-around, so "same" and "valid" need less
+   padding than "full". The kernel spectrum is computed by the constructor
+   and reused by every exec().
+   Correlation is convolution with the reversed kernel; the reversal is
+   done when the kernel is padded, which keeps the output region contiguous.
+   The pipeline transforms the input along the last axis (r2c) and then
+   along the other axes down to axis 1, skipping the lines which only
+   contain padding; along axis 0, each line is transformed, multiplied by
+   the kernel spectrum and transformed back in one go. The backward
+   transforms along the remaining axes only process the lines within the
+   output region, and the final c2r writes the output directly. */
+template<typename T> class plan_convolution
+  {
+  private:
+    shape_t shp_in, shp_out, len, start;
+    stride_t cstr;
+    arr<T> khc;                 // 1D: halfcomplex kernel spectrum
+    arr<cmplx<T>> kspec, work;  // otherwise: spectra of kernel and input
+    size_t nthreads;
+
+    shape_t cshape() const
+      {
+      shape_t res(len);
+      res.back() = len.back()/2+1;
+      return res;
+      }
+    /* the spectrum array starting at `ofs` along the axes before ax, with
+       extents ext[j] for j<ax */
+    ndarr<cmplx<T>> view(cmplx<T> *data, const shape_t &ext,
+      const shape_t &ofs, size_t ax) const
+      {
+      shape_t shp(cshape());
+      ptrdiff_t o=0;
+      for (size_t j=0; j<ax; ++j)
+        {
+        shp[j] = ext[j];
+        o += ptrdiff_t(ofs[j])*cstr[j];
         }
-#endif
-    while (it.remaining()>0)
-      {
-      it.advance(1);
-      auto tdata = reinterpret_cast<T *>(storage.data());
-      copy_input(it, in, tdata);
-      plan->exec(tdata, fct, true);
-      out[it.oofs(0)].Set(tdata[0]);
-      size_t i=1, ii=1;
-      if (forward)
-        for (; i<len-1; i+=2, ++ii)
-          out[it.oofs(ii)].Set(tdata[i], tdata[i+1]);
-      else
-        for (; i<len-1; i+=2, ++ii)
-          out[it.oofs(ii)].Set(tdata[i], -tdata[i+1]);
-      if (i<len)
-        out[it.oofs(ii)].Set(tdata[i]);
+      return ndarr<cmplx<T>>(reinterpret_cast<char *>(data)+o, shp, cstr);
       }
-    });  // end of parallel region
-  }
-template<typename T> POCKETFFT_NOINLINE void general_c2r(
-  const cndarr<cmplx<T>> &in, ndarr<T> &out, size_t axis, bool forward, T fct,
-  size_t nthreads)
-  {
-  auto plan = get_plan<pocketfft_r<T>>(out.shape(axis));
-  size_t len=out.shape(axis);
-  threading::thread_map(
-    util::thread_count(nthreads, in.shape(), axis, VLEN<T>::val),
-    [&] {
-      constexpr auto vlen = VLEN<T>::val;
-      auto storage = alloc_tmp<T>(out.shape(), len, sizeof(T));
-      multi_iter<vlen> it(in, out, axis);
-#ifndef POCKETFFT_NO_VECTORS
-      if (vlen>1)
-        while (it.remaining()>=vlen)
-          {
-          it.advance(vlen);
-          auto tdatav = reinterpret_cast<vtype_t<T> *>(storage.data());
-          for (size_t j=0; j<vlen; ++j)
-            tdatav[0][j]=in[it.iofs(j,0)].r;
+
+    /* zero-padded forward transform of x into spec, except along axis 0 if
+       `skip0` is set */
+    void forward(const cndarr<T> &x, cmplx<T> *spec, bool skip0)
+      {
+      size_t nd = len.size();
+      shape_t zero(nd, 0);
+      std::fill_n(spec, util::prod(cshape()), cmplx<T>(T(0), T(0)));
+      auto v = view(spec, x.shape(), zero, nd-1);
+      general_real_lines(x, v, nd-1, len.back(), T(1), nthreads,
+        ExecR2CPadded());
+      for (size_t ax=nd-1; ax-->(skip0 ? 1 : 0); )
+        {
+        auto va = view(spec, x.shape(), zero, ax);
+        general_nd<pocketfft_c<T>>(va, va, {ax}, T(1), nthreads,
+          ExecC2C{true});
+        }
+      }
+
+  public:
+    plan_convolution(const shape_t &shape_in, const shape_t &shape_kernel,
+      const stride_t &stride_kernel, const T *kernel, conv_mode mode,
+      bool correlate, size_t nthreads_=1)
+      : shp_in(shape_in), shp_out(shape_in.size()), len(shape_in.size()),
+        start(shape_in.size()), nthreads(nthreads_)
+      {
+      size_t nd = shape_in.size();
+      if ((nd==0) || (shape_kernel.size()!=nd))
+        throw std::invalid_argument("shape dimension mismatch");
+      if (stride_kernel.size()!=nd)
+        throw std::runtime_error("stride dimension mismatch");
+      if ((util::prod(shape_in)==0) || (util::prod(shape_kernel)==0))
+        throw std::invalid_argument("empty convolution operand");
+      const T *kdata = kernel;
+      stride_t kstr(stride_kernel);
+      for (size_t i=0; i<nd; ++i)
+        {
+        size_t na=shape_in[i], nb=shape_kernel[i], need=0;
+        switch (mode)
           {
-          size_t i=1, ii=1;
-          if (forward)
-            for (; i<len-1; i+=2, ++ii)
-              for (size_t j=0; j<vlen; ++j)
-                {
-                tdatav[i  ][j] =  in[it.iofs(j,ii)].r;
-                tdatav[i+1][j] = -in[it.iofs(j,ii)].i;
-                }
-          else
-            for (; i<len-1; i+=2, ++ii)
-              for (size_t j=0; j<vlen; ++j)
-                {
-                tdatav[i  ][j] = in[it.iofs(j,ii)].r;
-                tdatav[i+1][j] = in[it.iofs(j,ii)].i;
-                }
-          if (i<len)
-            for (size_t j=0; j<vlen; ++j)
-              tdatav[i][j] = in[it.iofs(j,ii)].r;
+          case conv_mode::full:
+            shp_out[i] = na+nb-1; start[i] = 0; need = na+nb-1;
+            break;
+          case conv_mode::same:
+            shp_out[i] = na; start[i] = (nb-1)/2; need = na+nb-1-start[i];
+            break;
+          case conv_mode::valid:
+            if (na<nb)
+              throw std::invalid_argument("kernel larger than input");
+            shp_out[i] = na-nb+1; start[i] = nb-1; need = na;
+            break;
           }
-          plan->exec(tdatav, fct, false);
-          copy_output(it, tdatav, out);
+        need = std::max(need, std::max(na, nb));
+        len[i] = (i+1==nd) ? util::good_size_real(need)
+                           : util::good_size_cmplx(need);
+        if (correlate)
+          {
+          kdata = reinterpret_cast<const T *>(
+            reinterpret_cast<const char *>(kdata)
+            + ptrdiff_t(nb-1)*stride_kernel[i]);
+          kstr[i] = -stride_kernel[i];
           }
-#endif
-      while (it.remaining()>0)
-        {
-        it.advance(1);
-        auto tdata = reinterpret_cast<T *>(storage.data());
-        tdata[0]=in[it.iofs(0)].r;
+        }
+      cndarr<T> ak(kdata, shape_kernel, kstr);
+      if (nd==1)
         {
-        size_t i=1, ii=1;
-        if (forward)
-          for (; i<len-1; i+=2, ++ii)
-            {
-            tdata[i  ] =  in[it.iofs(ii)].r;
-            tdata[i+1] = -in[it.iofs(ii)].i;
-            }
-        else
-          for (; i<len-1; i+=2, ++ii)
-            {
-            tdata[i  ] = in[it.iofs(ii)].r;
-            tdata[i+1] = in[it.iofs(ii)].i;
-            }
-        if (i<len)
-          tdata[i] = in[it.iofs(ii)].r;
+        khc.resize(len[0]);
+        for (size_t i=0; i<len[0]; ++i)
+          khc[i] = (i<shape_kernel[0]) ? ak[ptrdiff_t(i)*kstr[0]] : T(0);
+        get_plan<pocketfft_r<T>>(len[0])->exec(khc.data(), T(1), true);
+        return;
+        }
+      auto cs = cshape();
+      cstr.resize(nd);
+      cstr.back() = sizeof(cmplx<T>);
+      for (size_t i=nd-1; i>0; --i)
+        cstr[i-1] = cstr[i]*ptrdiff_t(cs[i]);
+      kspec.resize(util::prod(cs));
+      work.resize(util::prod(cs));
+      forward(ak, kspec.data(), false);
+      }
+
+    const shape_t &shape_out() const { return shp_out; }
+
+    void exec(const stride_t &stride_in, const T *data_in,
+      const stride_t &stride_out, T *data_out)
+      {
+      size_t nd = len.size();
+      if ((stride_in.size()!=nd) || (stride_out.size()!=nd))
+        throw std::runtime_error("stride dimension mismatch");
+      cndarr<T> ain(data_in, shp_in, stride_in);
+      ndarr<T> aout(data_out, shp_out, stride_out);
+      T fct = T(1)/T(util::prod(len));
+      if (nd==1)
+        {
+        general_real_lines(ain, aout, 0, len[0], fct, nthreads,
+          ExecConvR2R<T>{khc.data(), start[0]});
+        return;
         }
-        plan->exec(tdata, fct, false);
-        copy_output(it, tdata, out);
+      forward(ain, work.data(), true);
+      auto cs = cshape();
+      ndarr<cmplx<T>> aw(work.data(), cs, cstr);
+      cndarr<cmplx<T>> ak(kspec.data(), cs, cstr);
+      general_nd<pocketfft_c<T>>(aw, aw, {0}, fct, nthreads,
+        ExecConvC2C<T>{&ak});
+      for (size_t ax=1; ax+1<nd; ++ax)
+        {
+        auto va = view(work.data(), shp_out, start, ax);
+        general_nd<pocketfft_c<T>>(va, va, {ax}, T(1), nthreads,
+          ExecC2C{false});
         }
-    });  // end of parallel region
+      auto v = view(work.data(), shp_out, start, nd-1);
+      general_real_lines(v, aout, nd-1, len.back(), T(1), nthreads,
+        ExecC2RCrop{start.back()});
+      }
+  };
+
+template<typename T> void convolve(const shape_t &shape_in,
+  const stride_t &stride_in, const T *data_in, const shape_t &shape_kernel,
+  const stride_t &stride_kernel, const T *kernel, conv_mode mode,
+  const stride_t &stride_out, T *data_out, size_t nthreads=1)
+  {
+  plan_convolution<T> plan(shape_in, shape_kernel, stride_kernel, kernel,
+    mode, false, nthreads);
+  plan.exec(stride_in, data_in, stride_out, data_out);
   }
 
-struct ExecR2R
+template<typename T> void correlate(const shape_t &shape_in,
+  const stride_t &stride_in, const T *data_in, const shape_t &shape_kernel,
+  const stride_t &stride_kernel, const T *kernel, conv_mode mode,
+  const stride_t &stride_out, T *data_out, size_t nthreads=1)
   {
-  bool r2h, forward;
+  plan_convolution<T> plan(shape_in, shape_kernel, stride_kernel, kernel,
+    mode, true, nthreads);
+  plan.exec(stride_in, data_in, stride_out, data_out);
+  }
 
-  template <typename T0, typename T, size_t vlen> void operator () (
-    const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out, T * buf,
-    const pocketfft_r<T0> &plan, T0 fct) const
+#endif // end of the part compiled once per instruction set
+
+#if defined(POCKETFFT_FIRST_PASS) && !defined(POCKETFFT_ISA_LEVEL)
+#undef POCKETFFT_FIRST_PASS
+
+#ifdef POCKETFFT_RUNTIME_DISPATCH
+
+//
+// runtime dispatch
+//
+
+/* 0: isa_base, 1: isa_avx2, 2: isa_avx512, depending on the CPU. The
+   environment variable POCKETFFT_ISA ("base", "avx2" or "avx512") selects a
+   lower level, e.g. for testing; higher levels than supported are ignored. */
+inline int detect_isa_level()
+  {
+  __builtin_cpu_init();
+  int res = 0;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
     {
-    copy_input(it, in, buf);
-    if ((!r2h) && forward)
-      for (size_t i=2; i<it.length_out(); i+=2)
-        buf[i] = -buf[i];
-    plan.exec(buf, fct, r2h);
-    if (r2h && (!forward))
-      for (size_t i=2; i<it.length_out(); i+=2)
-        buf[i] = -buf[i];
-    copy_output(it, buf, out);
+    res = 1;
+    if (__builtin_cpu_supports("avx512f")) res = 2;
+    }
+  const char *env = std::getenv("POCKETFFT_ISA");
+  if (env)
+    {
+    std::string req(env);
+    if (req=="base") res = 0;
+    else if ((req=="avx2") && (res>1)) res = 1;
+    }
+  return res;
+  }
+inline int isa_level()
+  {
+  static const int level = detect_isa_level();
+  return level;
+  }
+
+#define POCKETFFT_DISPATCH(call) \
+  switch (isa_level()) \
+    { \
+    case 2: return isa_avx512::call; \
+    case 1: return isa_avx2::call; \
+    default: return isa_base::call; \
     }
-  };
 
 template<typename T> void c2c(const shape_t &shape, const stride_t &stride_in,
   const stride_t &stride_out, const shape_t &axes, bool forward,
   const std::complex<T> *data_in, std::complex<T> *data_out, T fct,
   size_t nthreads=1)
   {
-  if (util::prod(shape)==0) return;
-  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
-  cndarr<cmplx<T>> ain(data_in, shape, stride_in);
-  ndarr<cmplx<T>> aout(data_out, shape, stride_out);
-  general_nd<pocketfft_c<T>>(ain, aout, axes, fct, nthreads, ExecC2C{forward});
+  POCKETFFT_DISPATCH(c2c(shape, stride_in, stride_out, axes, forward, data_in,
+    data_out, fct, nthreads))
   }
 
 template<typename T> void dct(const shape_t &shape,
   const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
   int type, const T *data_in, T *data_out, T fct, bool ortho, size_t nthreads=1)
   {
-  if ((type<1) || (type>4)) throw std::invalid_argument("invalid DCT type");
-  if (util::prod(shape)==0) return;
-  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
-  cndarr<T> ain(data_in, shape, stride_in);
-  ndarr<T> aout(data_out, shape, stride_out);
-  const ExecDcst exec{ortho, type, true};
-  if (type==1)
-    general_nd<T_dct1<T>>(ain, aout, axes, fct, nthreads, exec);
-  else if (type==4)
-    general_nd<T_dcst4<T>>(ain, aout, axes, fct, nthreads, exec);
-  else
-    general_nd<T_dcst23<T>>(ain, aout, axes, fct, nthreads, exec);
+  POCKETFFT_DISPATCH(dct(shape, stride_in, stride_out, axes, type, data_in,
+    data_out, fct, ortho, nthreads))
   }
 
 template<typename T> void dst(const shape_t &shape,
   const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
   int type, const T *data_in, T *data_out, T fct, bool ortho, size_t nthreads=1)
   {
-  if ((type<1) || (type>4)) throw std::invalid_argument("invalid DST type");
-  if (util::prod(shape)==0) return;
-  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
-  cndarr<T> ain(data_in, shape, stride_in);
-  ndarr<T> aout(data_out, shape, stride_out);
-  const ExecDcst exec{ortho, type, false};
-  if (type==1)
-    general_nd<T_dst1<T>>(ain, aout, axes, fct, nthreads, exec);
-  else if (type==4)
-    general_nd<T_dcst4<T>>(ain, aout, axes, fct, nthreads, exec);
-  else
-    general_nd<T_dcst23<T>>(ain, aout, axes, fct, nthreads, exec);
+  POCKETFFT_DISPATCH(dst(shape, stride_in, stride_out, axes, type, data_in,
+    data_out, fct, ortho, nthreads))
+  }
+
+template<typename T> void mdct(const shape_t &shape_in,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  const T *window, const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(mdct(shape_in, stride_in, stride_out, axis, window,
+    data_in, data_out, fct, nthreads))
+  }
+
+template<typename T> void imdct(const shape_t &shape_out,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  const T *window, const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(imdct(shape_out, stride_in, stride_out, axis, window,
+    data_in, data_out, fct, nthreads))
+  }
+
+template<typename T> void stft(size_t len, ptrdiff_t stride_in,
+  const stride_t &stride_out, size_t nperseg, size_t hop, const T *window,
+  bool forward, const T *data_in, std::complex<T> *data_out, T fct,
+  size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(stft(len, stride_in, stride_out, nperseg, hop, window,
+    forward, data_in, data_out, fct, nthreads))
+  }
+
+template<typename T> void istft(size_t len, const stride_t &stride_in,
+  ptrdiff_t stride_out, size_t nperseg, size_t hop, const T *window,
+  bool forward, const std::complex<T> *data_in, T *data_out, T fct,
+  size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(istft(len, stride_in, stride_out, nperseg, hop, window,
+    forward, data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void r2c(const shape_t &shape_in,
@@ -3421,13 +8571,16 @@ template<typename T> void r2c(const shape_t &shape_in,
   bool forward, const T *data_in, std::complex<T> *data_out, T fct,
   size_t nthreads=1)
   {
-  if (util::prod(shape_in)==0) return;
-  util::sanity_check(shape_in, stride_in, stride_out, false, axis);
-  cndarr<T> ain(data_in, shape_in, stride_in);
-  shape_t shape_out(shape_in);
-  shape_out[axis] = shape_in[axis]/2 + 1;
-  ndarr<cmplx<T>> aout(data_out, shape_out, stride_out);
-  general_r2c(ain, aout, axis, forward, fct, nthreads);
+  POCKETFFT_DISPATCH(r2c(shape_in, stride_in, stride_out, axis, forward,
+    data_in, data_out, fct, nthreads))
+  }
+
+template<typename T> void r2c(const shape_t &shape_in,
+  const stride_t &stride_in, const stride_t &stride_out, size_t axis,
+  spectrum mode, const T *data_in, T *data_out, T fct, size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(r2c(shape_in, stride_in, stride_out, axis, mode,
+    data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void r2c(const shape_t &shape_in,
@@ -3435,17 +8588,8 @@ template<typename T> void r2c(const shape_t &shape_in,
   bool forward, const T *data_in, std::complex<T> *data_out, T fct,
   size_t nthreads=1)
   {
-  if (util::prod(shape_in)==0) return;
-  util::sanity_check(shape_in, stride_in, stride_out, false, axes);
-  r2c(shape_in, stride_in, stride_out, axes.back(), forward, data_in, data_out,
-    fct, nthreads);
-  if (axes.size()==1) return;
-
-  shape_t shape_out(shape_in);
-  shape_out[axes.back()] = shape_in[axes.back()]/2 + 1;
-  auto newaxes = shape_t{axes.begin(), --axes.end()};
-  c2c(shape_out, stride_out, stride_out, newaxes, forward, data_out, data_out,
-    T(1), nthreads);
+  POCKETFFT_DISPATCH(r2c(shape_in, stride_in, stride_out, axes, forward,
+    data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void c2r(const shape_t &shape_out,
@@ -3453,13 +8597,8 @@ template<typename T> void c2r(const shape_t &shape_out,
   bool forward, const std::complex<T> *data_in, T *data_out, T fct,
   size_t nthreads=1)
   {
-  if (util::prod(shape_out)==0) return;
-  util::sanity_check(shape_out, stride_in, stride_out, false, axis);
-  shape_t shape_in(shape_out);
-  shape_in[axis] = shape_out[axis]/2 + 1;
-  cndarr<cmplx<T>> ain(data_in, shape_in, stride_in);
-  ndarr<T> aout(data_out, shape_out, stride_out);
-  general_c2r(ain, aout, axis, forward, fct, nthreads);
+  POCKETFFT_DISPATCH(c2r(shape_out, stride_in, stride_out, axis, forward,
+    data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void c2r(const shape_t &shape_out,
@@ -3467,25 +8606,8 @@ template<typename T> void c2r(const shape_t &shape_out,
   bool forward, const std::complex<T> *data_in, T *data_out, T fct,
   size_t nthreads=1)
   {
-  if (util::prod(shape_out)==0) return;
-  if (axes.size()==1)
-    return c2r(shape_out, stride_in, stride_out, axes[0], forward,
-      data_in, data_out, fct, nthreads);
-  util::sanity_check(shape_out, stride_in, stride_out, false, axes);
-  auto shape_in = shape_out;
-  shape_in[axes.back()] = shape_out[axes.back()]/2 + 1;
-  auto nval = util::prod(shape_in);
-  stride_t stride_inter(shape_in.size());
-  stride_inter.back() = sizeof(cmplx<T>);
-  for (int i=int(shape_in.size())-2; i>=0; --i)
-    stride_inter[size_t(i)] =
-      stride_inter[size_t(i+1)]*ptrdiff_t(shape_in[size_t(i+1)]);
-  arr<std::complex<T>> tmp(nval);
-  auto newaxes = shape_t{axes.begin(), --axes.end()};
-  c2c(shape_in, stride_in, stride_inter, newaxes, forward, data_in, tmp.data(),
-    T(1), nthreads);
-  c2r(shape_out, stride_inter, stride_out, axes.back(), forward,
-    tmp.data(), data_out, fct, nthreads);
+  POCKETFFT_DISPATCH(c2r(shape_out, stride_in, stride_out, axes, forward,
+    data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void r2r_fftpack(const shape_t &shape,
@@ -3493,56 +8615,274 @@ template<typename T> void r2r_fftpack(const shape_t &shape,
   bool real2hermitian, bool forward, const T *data_in, T *data_out, T fct,
   size_t nthreads=1)
   {
-  if (util::prod(shape)==0) return;
-  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
-  cndarr<T> ain(data_in, shape, stride_in);
-  ndarr<T> aout(data_out, shape, stride_out);
-  general_nd<pocketfft_r<T>>(ain, aout, axes, fct, nthreads,
-    ExecR2R{real2hermitian, forward});
+  POCKETFFT_DISPATCH(r2r_fftpack(shape, stride_in, stride_out, axes,
+    real2hermitian, forward, data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void r2r_separable_hartley(const shape_t &shape,
   const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
   const T *data_in, T *data_out, T fct, size_t nthreads=1)
   {
-  if (util::prod(shape)==0) return;
-  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
-  cndarr<T> ain(data_in, shape, stride_in);
-  ndarr<T> aout(data_out, shape, stride_out);
-  general_nd<pocketfft_r<T>>(ain, aout, axes, fct, nthreads, ExecHartley{},
-    false);
+  POCKETFFT_DISPATCH(r2r_separable_hartley(shape, stride_in, stride_out, axes,
+    data_in, data_out, fct, nthreads))
   }
 
 template<typename T> void r2r_genuine_hartley(const shape_t &shape,
   const stride_t &stride_in, const stride_t &stride_out, const shape_t &axes,
   const T *data_in, T *data_out, T fct, size_t nthreads=1)
   {
-  if (util::prod(shape)==0) return;
-  if (axes.size()==1)
-    return r2r_separable_hartley(shape, stride_in, stride_out, axes, data_in,
-      data_out, fct, nthreads);
-  util::sanity_check(shape, stride_in, stride_out, data_in==data_out, axes);
-  shape_t tshp(shape);
-  tshp[axes.back()] = tshp[axes.back()]/2+1;
-  arr<std::complex<T>> tdata(util::prod(tshp));
-  stride_t tstride(shape.size());
-  tstride.back()=sizeof(std::complex<T>);
-  for (size_t i=tstride.size()-1; i>0; --i)
-    tstride[i-1]=tstride[i]*ptrdiff_t(tshp[i]);
-  r2c(shape, stride_in, tstride, axes, true, data_in, tdata.data(), fct, nthreads);
-  cndarr<cmplx<T>> atmp(tdata.data(), tshp, tstride);
-  ndarr<T> aout(data_out, shape, stride_out);
-  simple_iter iin(atmp);
-  rev_iter iout(aout, axes);
-  while(iin.remaining()>0)
-    {
-    auto v = atmp[iin.ofs()];
-    aout[iout.ofs()] = v.r+v.i;
-    aout[iout.rev_ofs()] = v.r-v.i;
-    iin.advance(); iout.advance();
+  POCKETFFT_DISPATCH(r2r_genuine_hartley(shape, stride_in, stride_out, axes,
+    data_in, data_out, fct, nthreads))
+  }
+
+/* Only the plan cache of the selected variant is ever used. */
+inline void set_plan_cache_limits(size_t max_plans, size_t max_bytes)
+  { POCKETFFT_DISPATCH(set_plan_cache_limits(max_plans, max_bytes)) }
+inline void set_plan_cache_size(size_t max_plans)
+  { POCKETFFT_DISPATCH(set_plan_cache_size(max_plans)) }
+inline void set_plan_cache_memory(size_t max_bytes)
+  { POCKETFFT_DISPATCH(set_plan_cache_memory(max_bytes)) }
+inline size_t plan_cache_memory_usage()
+  { POCKETFFT_DISPATCH(plan_cache_memory_usage()) }
+inline void clear_plan_cache()
+  { POCKETFFT_DISPATCH(clear_plan_cache()) }
+inline size_t load_plans(const std::string &filename)
+  { POCKETFFT_DISPATCH(load_plans(filename)) }
+
+#define POCKETFFT_DISPATCH_MEMBER(call) \
+  switch (isa_level()) \
+    { \
+    case 2: return s2.call; \
+    case 1: return s1.call; \
+    default: return s0.call; \
     }
+
+class plan_set
+  {
+  private:
+    isa_base::plan_set s0;
+    isa_avx2::plan_set s1;
+    isa_avx512::plan_set s2;
+
+  public:
+    template<typename T> void add_c2c(size_t length)
+      { POCKETFFT_DISPATCH_MEMBER(add_c2c<T>(length)) }
+    template<typename T> void add_r2c(size_t length)
+      { POCKETFFT_DISPATCH_MEMBER(add_r2c<T>(length)) }
+    template<typename T> void add_dct(int type, size_t length)
+      { POCKETFFT_DISPATCH_MEMBER(add_dct<T>(type, length)) }
+    template<typename T> void add_dst(int type, size_t length)
+      { POCKETFFT_DISPATCH_MEMBER(add_dst<T>(type, length)) }
+    size_t size() const
+      { POCKETFFT_DISPATCH_MEMBER(size()) }
+    void save(const std::string &filename) const
+      { POCKETFFT_DISPATCH_MEMBER(save(filename)) }
+  };
+
+/* Holds the variant of a reusable plan for the selected instruction set. */
+template<typename P0, typename P1, typename P2> class isa_plan
+  {
+  protected:
+    std::unique_ptr<P0> p0;
+    std::unique_ptr<P1> p1;
+    std::unique_ptr<P2> p2;
+
+    template<typename... Args> void init(const Args &... args)
+      {
+      switch (isa_level())
+        {
+        case 2: p2.reset(new P2(args...)); break;
+        case 1: p1.reset(new P1(args...)); break;
+        default: p0.reset(new P0(args...));
+        }
+      }
+
+  public:
+    template<typename Tin, typename Tout, typename T0>
+      void exec(const Tin *data_in, Tout *data_out, T0 fct)
+      {
+      if (p2) p2->exec(data_in, data_out, fct);
+      else if (p1) p1->exec(data_in, data_out, fct);
+      else p0->exec(data_in, data_out, fct);
+      }
+  };
+
+template<typename T> class plan_c2c: public isa_plan<isa_base::plan_c2c<T>,
+  isa_avx2::plan_c2c<T>, isa_avx512::plan_c2c<T>>
+  {
+  public:
+    plan_c2c(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool forward,
+      size_t nthreads=1)
+      { this->init(shape, stride_in, stride_out, axes, forward, nthreads); }
+  };
+
+template<typename T> class plan_r2c: public isa_plan<isa_base::plan_r2c<T>,
+  isa_avx2::plan_r2c<T>, isa_avx512::plan_r2c<T>>
+  {
+  public:
+    plan_r2c(const shape_t &shape_in, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool forward,
+      size_t nthreads=1)
+      { this->init(shape_in, stride_in, stride_out, axes, forward, nthreads); }
+    plan_r2c(const shape_t &shape_in, const stride_t &stride_in,
+      const stride_t &stride_out, size_t axis, bool forward,
+      size_t nthreads=1)
+      { this->init(shape_in, stride_in, stride_out, axis, forward, nthreads); }
+  };
+
+template<typename T> class plan_c2r: public isa_plan<isa_base::plan_c2r<T>,
+  isa_avx2::plan_c2r<T>, isa_avx512::plan_c2r<T>>
+  {
+  public:
+    plan_c2r(const shape_t &shape_out, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool forward,
+      size_t nthreads=1)
+      { this->init(shape_out, stride_in, stride_out, axes, forward, nthreads); }
+    plan_c2r(const shape_t &shape_out, const stride_t &stride_in,
+      const stride_t &stride_out, size_t axis, bool forward,
+      size_t nthreads=1)
+      { this->init(shape_out, stride_in, stride_out, axis, forward, nthreads); }
+  };
+
+template<typename T> class plan_r2r_fftpack: public isa_plan<
+  isa_base::plan_r2r_fftpack<T>, isa_avx2::plan_r2r_fftpack<T>,
+  isa_avx512::plan_r2r_fftpack<T>>
+  {
+  public:
+    plan_r2r_fftpack(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, bool real2hermitian,
+      bool forward, size_t nthreads=1)
+      {
+      this->init(shape, stride_in, stride_out, axes, real2hermitian, forward,
+        nthreads);
+      }
+  };
+
+template<typename T> class plan_dct: public isa_plan<isa_base::plan_dct<T>,
+  isa_avx2::plan_dct<T>, isa_avx512::plan_dct<T>>
+  {
+  public:
+    plan_dct(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, int type, bool ortho,
+      size_t nthreads=1)
+      { this->init(shape, stride_in, stride_out, axes, type, ortho, nthreads); }
+  };
+
+template<typename T> class plan_dst: public isa_plan<isa_base::plan_dst<T>,
+  isa_avx2::plan_dst<T>, isa_avx512::plan_dst<T>>
+  {
+  public:
+    plan_dst(const shape_t &shape, const stride_t &stride_in,
+      const stride_t &stride_out, const shape_t &axes, int type, bool ortho,
+      size_t nthreads=1)
+      { this->init(shape, stride_in, stride_out, axes, type, ortho, nthreads); }
+  };
+
+template<typename T> class fir_filter: public isa_plan<
+  isa_base::fir_filter<T>, isa_avx2::fir_filter<T>, isa_avx512::fir_filter<T>>
+  {
+  public:
+    fir_filter(const T *taps, size_t ntaps, size_t nchannels,
+      const stride_t &stride_in, const stride_t &stride_out,
+      size_t nthreads=1, size_t block=0)
+      {
+      this->init(taps, ntaps, nchannels, stride_in, stride_out, nthreads,
+        block);
+      }
+    fir_filter(const T *taps, size_t ntaps, size_t block=0)
+      { this->init(taps, ntaps, block); }
+
+    void reset()
+      {
+      if (this->p2) this->p2->reset();
+      else if (this->p1) this->p1->reset();
+      else this->p0->reset();
+      }
+    size_t fft_length() const
+      {
+      return this->p2 ? this->p2->fft_length() :
+             this->p1 ? this->p1->fft_length() : this->p0->fft_length();
+      }
+    size_t step_size() const
+      {
+      return this->p2 ? this->p2->step_size() :
+             this->p1 ? this->p1->step_size() : this->p0->step_size();
+      }
+  };
+
+template<typename T> class partitioned_fir_filter: public isa_plan<
+  isa_base::partitioned_fir_filter<T>, isa_avx2::partitioned_fir_filter<T>,
+  isa_avx512::partitioned_fir_filter<T>>
+  {
+  public:
+    partitioned_fir_filter(const T *taps, size_t ntaps, size_t block,
+      size_t max_block=0)
+      { this->init(taps, ntaps, block, max_block); }
+
+    void reset()
+      {
+      if (this->p2) this->p2->reset();
+      else if (this->p1) this->p1->reset();
+      else this->p0->reset();
+      }
+    size_t block_size() const
+      {
+      return this->p2 ? this->p2->block_size() :
+             this->p1 ? this->p1->block_size() : this->p0->block_size();
+      }
+  };
+
+template<typename T> class plan_convolution: public isa_plan<
+  isa_base::plan_convolution<T>, isa_avx2::plan_convolution<T>,
+  isa_avx512::plan_convolution<T>>
+  {
+  public:
+    plan_convolution(const shape_t &shape_in, const shape_t &shape_kernel,
+      const stride_t &stride_kernel, const T *kernel, conv_mode mode,
+      bool correlate, size_t nthreads=1)
+      {
+      this->init(shape_in, shape_kernel, stride_kernel, kernel, mode,
+        correlate, nthreads);
+      }
+
+    const shape_t &shape_out() const
+      {
+      return this->p2 ? this->p2->shape_out() :
+             this->p1 ? this->p1->shape_out() : this->p0->shape_out();
+      }
+    void exec(const stride_t &stride_in, const T *data_in,
+      const stride_t &stride_out, T *data_out)
+      {
+      if (this->p2) this->p2->exec(stride_in, data_in, stride_out, data_out);
+      else if (this->p1)
+        this->p1->exec(stride_in, data_in, stride_out, data_out);
+      else this->p0->exec(stride_in, data_in, stride_out, data_out);
+      }
+  };
+
+template<typename T> void convolve(const shape_t &shape_in,
+  const stride_t &stride_in, const T *data_in, const shape_t &shape_kernel,
+  const stride_t &stride_kernel, const T *kernel, conv_mode mode,
+  const stride_t &stride_out, T *data_out, size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(convolve(shape_in, stride_in, data_in, shape_kernel,
+    stride_kernel, kernel, mode, stride_out, data_out, nthreads))
+  }
+
+template<typename T> void correlate(const shape_t &shape_in,
+  const stride_t &stride_in, const T *data_in, const shape_t &shape_kernel,
+  const stride_t &stride_kernel, const T *kernel, conv_mode mode,
+  const stride_t &stride_out, T *data_out, size_t nthreads=1)
+  {
+  POCKETFFT_DISPATCH(correlate(shape_in, stride_in, data_in, shape_kernel,
+    stride_kernel, kernel, mode, stride_out, data_out, nthreads))
   }
 
+#undef POCKETFFT_DISPATCH_MEMBER
+#undef POCKETFFT_DISPATCH
+#endif
+
 } // namespace detail
 
 using detail::FORWARD;
@@ -3552,15 +8892,43 @@ using detail::stride_t;
 using detail::c2c;
 using detail::c2r;
 using detail::r2c;
+using detail::spectrum;
 using detail::r2r_fftpack;
 using detail::r2r_separable_hartley;
 using detail::r2r_genuine_hartley;
 using detail::dct;
 using detail::dst;
+using detail::mdct;
+using detail::imdct;
+using detail::stft_frames;
+using detail::stft;
+using detail::istft;
+using detail::plan_c2c;
+using detail::plan_r2c;
+using detail::plan_c2r;
+using detail::plan_r2r_fftpack;
+using detail::plan_dct;
+using detail::plan_dst;
+using detail::fir_filter;
+using detail::partitioned_fir_filter;
+using detail::conv_mode;
+using detail::plan_convolution;
+using detail::convolve;
+using detail::correlate;
+using detail::set_plan_cache_limits;
+using detail::set_plan_cache_size;
+using detail::set_plan_cache_memory;
+using detail::plan_cache_memory_usage;
+using detail::clear_plan_cache;
+using detail::plan_set;
+using detail::load_plans;
+using detail::planning_mode;
+using detail::set_planning_mode;
+using detail::get_planning_mode;
 
 } // namespace pocketfft
 
 #undef POCKETFFT_NOINLINE
 #undef POCKETFFT_RESTRICT
 
-#endif // POCKETFFT_HDRONLY_H
+#endif